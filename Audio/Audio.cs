@@ -20,6 +20,9 @@ using System;
 using System.Collections.Generic;
 using System.Collections.ObjectModel;
 using System.IO;
+using System.Runtime.InteropServices;
+using System.Text;
+using System.Threading;
 using AdamMil.Utilities;
 using GameLib.Interop.GLMixer;
 using GameLib.Interop.SDL;
@@ -45,11 +48,16 @@ public enum SampleFormat : short
 }
 
 public enum Speakers { None, Mono=1, Stereo=2 }
+public enum AudioOutput { Sdl=GLMixer.Backend.Sdl, Null=GLMixer.Backend.Null, WaveFile=GLMixer.Backend.WaveFile }
 public enum ChannelStatus { Stopped, Playing, Paused }
 public enum Fade { None, In, Out }
 public enum PlayPolicy { Fail, Oldest, Priority, OldestPriority }
 public enum MixPolicy { DontDivide, Divide }
 public enum FilterCombination { Series, ParallelSum, ParallelAverage }
+public enum AudioLoadLevel { Normal, NoOptionalEffects, LowQuality, FewerVoices, Critical }
+// Full uses cubic resampling, Reduced linear resampling, Low also bypasses filters, and Minimal uses nearest-neighbor
+// resampling and mixes the channel in mono. Auto picks a level from the channel's volume and priority
+public enum AudioDetail { Auto=-1, Full, Reduced, Low, Minimal }
 
 public struct SizedArray
 {
@@ -116,6 +124,137 @@ public struct AudioFormat
   }
 }
 
+// the loudness of a sound, from Audio.AnalyzeLoudness
+public struct LoudnessInfo
+{
+  public float Loudness; // the integrated loudness, in LUFS, or negative infinity if the sound is silent
+  public float TruePeak; // the true peak level, in dBTP, or negative infinity if the sound is silent
+  public float Gain;     // the linear gain that brings the sound to the target loudness, for AudioSource.Normalization
+}
+
+public struct AudioLoadStatistics
+{
+  public int Buffers, Overruns, DegradedBuffers, VirtualizedVoices;
+  public int LastCostMicroseconds, PeakCostMicroseconds;
+  public float Load; // the smoothed mixing time as a fraction of the buffer period
+  public AudioLoadLevel Level;
+}
+
+public struct AudioRecordingStatistics
+{
+  public long FramesWritten;
+  public int DroppedFrames; // frames lost because the disk writer fell behind the mixer
+  public int Overflows;     // the number of buffers dropped
+  public bool Recording, Failed;
+}
+
+public enum AudioThread { Mixer, Worker }
+public enum ThreadSchedule { Normal, Fifo, RoundRobin }
+
+public struct AudioThreadPolicy
+{
+  public AudioThreadPolicy(ThreadSchedule schedule, int priority, long affinity)
+  {
+    Schedule=schedule; Priority=priority; Affinity=affinity;
+  }
+
+  public ThreadSchedule Schedule;
+  public int Priority; // the realtime priority (1-99) for Fifo and RoundRobin, or the nice value (-20 to 19) for Normal
+  public long Affinity; // a mask of the CPUs the thread may run on, or 0 to leave it unchanged
+}
+
+// identifies a single sound playing on a channel. channels are reused when sounds finish or are stolen, so operations
+// through a handle do nothing once its sound is gone. handles can be used from any thread without locking
+public struct VoiceHandle
+{
+  internal VoiceHandle(uint value) { this.value = value; }
+
+  // gets the channel playing the sound, or null if the handle is stale
+  public Channel Channel
+  {
+    get
+    {
+      int voice = GLMixer.VoiceFromHandle(value);
+      ReadOnlyCollection<Channel> chans = Audio.Channels;
+      return voice<0 || voice>=chans.Count ? null : chans[voice];
+    }
+  }
+
+  public bool IsValid { get { return GLMixer.VoiceFromHandle(value)>=0; } }
+
+  public override bool Equals(object obj) { return obj is VoiceHandle && ((VoiceHandle)obj).value==value; }
+  public override int GetHashCode() { return (int)value; }
+
+  // these are applied by the mixer at the start of the next buffer, and return false if the handle was already stale
+  public bool FadeOut(int fadeMs)
+  {
+    if(fadeMs<0) throw new ArgumentOutOfRangeException("fadeMs", "cannot be negative");
+    return Post(GLMixer.GroupCommand.FadeOut, fadeMs);
+  }
+  public bool Pause() { return Post(GLMixer.GroupCommand.Pause, 0); }
+  public bool Resume() { return Post(GLMixer.GroupCommand.Resume, 0); }
+  public bool Stop() { return Post(GLMixer.GroupCommand.Stop, 0); }
+  // restarts the attack of the channel's ADSR envelope, or starts its release
+  public bool NoteOn() { return Post(GLMixer.GroupCommand.NoteOn, 0); }
+  public bool NoteOff() { return Post(GLMixer.GroupCommand.NoteOff, 0); }
+  // sets a volume that applies on top of the channel's own volume, until the sound ends
+  public bool SetVolume(int volume)
+  {
+    Audio.CheckVolume(volume);
+    return Post(GLMixer.GroupCommand.Volume, volume);
+  }
+
+  bool Post(GLMixer.GroupCommand command, int arg)
+  {
+    int result = GLMixer.PostVoiceCommand(value, command, arg);
+    GLMixer.Check(result);
+    return result!=0;
+  }
+
+  uint value;
+}
+
+public enum AutomationParameter { Volume, Pan, Rate }
+public enum AutomationCurve { Linear, Exponential }
+
+// a point on an automation envelope. the curve is the shape of the segment leading up to the point. exponential
+// segments sound more even for volume and pitch sweeps, but both of their ends must be above zero
+public struct Breakpoint
+{
+  public Breakpoint(int timeMs, float value) : this(timeMs, value, AutomationCurve.Linear) { }
+  public Breakpoint(int timeMs, float value, AutomationCurve curve)
+  {
+    if(timeMs<0) throw new ArgumentOutOfRangeException("timeMs", "cannot be negative");
+    TimeMs=timeMs; Value=value; Curve=curve;
+  }
+
+  public int TimeMs; // the time of the point, from when the envelope is submitted
+  public float Value;
+  public AutomationCurve Curve;
+}
+
+// an attack/decay/sustain/release envelope, run by the mixer. the attack starts with each sound played on the
+// channel, the sustain level (0 to 1) is held until note-off, and the channel stops when the release ends
+public struct AdsrEnvelope
+{
+  public AdsrEnvelope(int attackMs, int decayMs, float sustain, int releaseMs)
+    : this(attackMs, decayMs, sustain, releaseMs, AutomationCurve.Linear) { }
+  public AdsrEnvelope(int attackMs, int decayMs, float sustain, int releaseMs, AutomationCurve curve)
+  {
+    if(attackMs<0) throw new ArgumentOutOfRangeException("attackMs", "cannot be negative");
+    if(decayMs<0) throw new ArgumentOutOfRangeException("decayMs", "cannot be negative");
+    if(releaseMs<0) throw new ArgumentOutOfRangeException("releaseMs", "cannot be negative");
+    if(sustain<0 || sustain>1) throw new ArgumentOutOfRangeException("sustain", "must be from 0 to 1");
+    AttackMs=attackMs; DecayMs=decayMs; Sustain=sustain; ReleaseMs=releaseMs;
+    AttackCurve=DecayCurve=ReleaseCurve=curve;
+  }
+
+  public int AttackMs, DecayMs;
+  public float Sustain;
+  public int ReleaseMs;
+  public AutomationCurve AttackCurve, DecayCurve, ReleaseCurve;
+}
+
 public delegate void ChannelFinishedHandler(Channel channel);
 #endregion
 
@@ -149,6 +288,19 @@ public abstract class AudioSource : IDisposable
     protected set { length = value; }
   }
 
+  // a gain applied along with the source's volume when it's mixed, eg, to normalize its loudness. gains above 1
+  // amplify the source, up to the mixer's limit of 256
+  public float Normalization
+  {
+    get { return normalization; }
+    set
+    {
+      if(value<0) throw new ArgumentOutOfRangeException("Normalization", value, "cannot be negative");
+      normalization = value;
+      normVolume    = value>=ushort.MaxValue/Audio.MaxVolume ? ushort.MaxValue : (int)(value*Audio.MaxVolume+0.5f);
+    }
+  }
+
   public float PlaybackRate { get { return rate; } set { Audio.CheckRate(rate); lock(this) rate=value; } }
 
   public abstract int Position { get; set; }
@@ -305,10 +457,10 @@ public abstract class AudioSource : IDisposable
 
   protected byte[] buffer;
   [CLSCompliant(false)] protected AudioFormat format;
-  float rate=1f;
+  float rate=1f, normalization=1f;
   protected int curPos;
   int left=Audio.MaxVolume, right=Audio.MaxVolume, length=-1;
-  internal int playing;
+  internal int playing, normVolume=Audio.MaxVolume;
 }
 #endregion
 
@@ -448,6 +600,124 @@ public class ToneGenerator : AudioSource
 }
 #endregion
 
+#region NoiseSource
+public enum NoiseType { White, Pink, Brown };
+// generates noise natively in the mixer's format, so that it's mixed straight into the output without the memory use
+// or audible repetition of a looped sample. the noise can be colored further with low- and high-pass filters
+public class NoiseSource : AudioSource
+{
+  public NoiseSource(NoiseType type) : this(type, (uint)Environment.TickCount) { }
+  [CLSCompliant(false)]
+  public NoiseSource(NoiseType type, uint seed)
+  {
+    if(!Audio.Initialized) throw new InvalidOperationException("The audio system has not been initialized");
+    noise = GLMixer.CreateNoise(type, seed);
+    if(noise==IntPtr.Zero) SDL.RaiseError();
+    this.type = type;
+    format = Audio.Format;
+  }
+
+  ~NoiseSource() { Dispose(true); }
+
+  public override bool CanRewind { get { return true; } }
+  public override bool CanSeek { get { return true; } }
+  public override int Position { get { return curPos; } set { curPos=value; } }
+
+  // the cutoff frequency of the low-pass filter, in Hz, or zero if it's disabled
+  public int LowPass
+  {
+    get { return lowPass; }
+    set { SetFilter(value, highPass); }
+  }
+
+  // the cutoff frequency of the high-pass filter, in Hz, or zero if it's disabled
+  public int HighPass
+  {
+    get { return highPass; }
+    set { SetFilter(lowPass, value); }
+  }
+
+  public NoiseType Type { get { return type; } }
+
+  public override byte[] ReadAll()
+  {
+    throw new NotSupportedException("NoiseSource is an infinite data source and can't be read in its entirety.");
+  }
+
+  public override int ReadBytes(byte[] buf, int index, int length)
+  {
+    int frames = BytesToFrames(length), samples = frames*Format.Channels;
+    if(index<0 || length<0 || index+length>buf.Length) throw new ArgumentOutOfRangeException();
+    lock(this)
+    {
+      AssertOpen();
+      if(accBuffer==null || accBuffer.Length<samples) accBuffer = new int[samples];
+      unsafe
+      {
+        fixed(int* acc = accBuffer)
+        fixed(byte* dest = buf)
+        {
+          Unsafe.Clear(acc, samples*sizeof(int));
+          GLMixer.Check(GLMixer.MixNoise(noise, acc, (uint)frames, Audio.MaxVolume, Audio.MaxVolume));
+          GLMixer.Check(GLMixer.ConvertAccumulator(dest+index, acc, (uint)samples, (ushort)Format.Format));
+        }
+      }
+      curPos += frames;
+      return frames*Format.FrameSize;
+    }
+  }
+
+  [CLSCompliant(false)]
+  public override unsafe int ReadFrames(int* dest, int frames, int left, int right)
+  {
+    lock(this)
+    {
+      AssertOpen();
+      GLMixer.Check(GLMixer.MixNoise(noise, dest, (uint)frames, (ushort)(left <0 ? Audio.MaxVolume : left),
+                                     (ushort)(right<0 ? Audio.MaxVolume : right)));
+      curPos += frames;
+      return frames;
+    }
+  }
+
+  protected override void Dispose(bool finalizing)
+  {
+    lock(this)
+    {
+      if(noise!=IntPtr.Zero)
+      {
+        GLMixer.FreeNoise(noise);
+        noise = IntPtr.Zero;
+      }
+    }
+    base.Dispose(finalizing);
+  }
+
+  void AssertOpen()
+  {
+    if(noise==IntPtr.Zero) throw new ObjectDisposedException("NoiseSource");
+  }
+
+  void SetFilter(int lowPass, int highPass)
+  {
+    if(lowPass<0 || highPass<0)
+      throw new ArgumentOutOfRangeException(lowPass<0 ? "LowPass" : "HighPass", "cannot be negative");
+    lock(this)
+    {
+      AssertOpen();
+      GLMixer.Check(GLMixer.SetNoiseFilter(noise, (uint)lowPass, (uint)highPass));
+      this.lowPass  = lowPass;
+      this.highPass = highPass;
+    }
+  }
+
+  IntPtr noise;
+  int[] accBuffer;
+  int lowPass, highPass;
+  NoiseType type;
+}
+#endregion
+
 #region StreamSource
 public abstract class StreamSource : AudioSource
 {
@@ -513,6 +783,116 @@ public class RawSource : StreamSource
 }
 #endregion
 
+#region MappedSource
+// plays an uncompressed WAV or raw file straight from a memory mapping. the OS reads the file ahead of playback, and
+// when the file is in the mixer's format, the samples are mixed directly from the mapped pages without being copied
+public class MappedSource : AudioSource
+{
+  public MappedSource(string filename) // for 8-bit and 16-bit PCM WAV files
+  {
+    if(filename==null) throw new ArgumentNullException("filename");
+    GLMixer.MapInfo info;
+    file = GLMixer.MapWave(filename, out info);
+    Init(ref info);
+  }
+  public MappedSource(string filename, AudioFormat format) : this(filename, format, 0, 0) { } // for RAW
+  public MappedSource(string filename, AudioFormat format, int start, int length) // a length of 0 means the rest
+  {
+    if(filename==null) throw new ArgumentNullException("filename");
+    if(start<0 || length<0) throw new ArgumentOutOfRangeException(start<0 ? "start" : "length", "cannot be negative");
+    GLMixer.MapInfo info = new GLMixer.MapInfo();
+    info.freq     = (uint)format.Frequency;
+    info.format   = (ushort)format.Format;
+    info.channels = format.Channels;
+    file = GLMixer.MapRaw(filename, (uint)start, (uint)length, ref info);
+    Init(ref info);
+  }
+
+  ~MappedSource() { Dispose(true); }
+
+  public override bool CanRewind { get { return true; } }
+  public override bool CanSeek { get { return true; } }
+  public override int Position
+  {
+    get { return curPos; }
+    set
+    {
+      if(value==curPos) return;
+      if(value<0 || value>Length) throw new ArgumentOutOfRangeException("Position");
+      lock(this)
+      {
+        AssertOpen();
+        curPos = value;
+        unsafe { GLMixer.Check(GLMixer.AdviseMapping(file, data+curPos*Format.FrameSize, ReadAhead)); }
+      }
+    }
+  }
+
+  public override int ReadBytes(byte[] buf, int index, int length)
+  {
+    int frames = BytesToFrames(length);
+    if(index<0 || length<0 || index+length>buf.Length) throw new ArgumentOutOfRangeException();
+    lock(this)
+    {
+      AssertOpen();
+      int toRead = Math.Min(frames, Length-curPos)*Format.FrameSize;
+      unsafe { fixed(byte* dest = buf) Unsafe.Copy(data+curPos*Format.FrameSize, dest+index, toRead); }
+      curPos += toRead/Format.FrameSize;
+      return toRead;
+    }
+  }
+
+  [CLSCompliant(false)]
+  public override unsafe int ReadFrames(int* dest, int frames, int left, int right)
+  {
+    lock(this)
+    {
+      AssertOpen();
+      int toRead=Math.Min(Length-curPos, frames);
+      GLMixer.Check(GLMixer.ConvertMix(dest, data+curPos*Format.FrameSize, (uint)(toRead*Format.Channels),
+                                       (ushort)Format.Format, Format.Channels,
+                                       (ushort)(left <0 ? Audio.MaxVolume : left),
+                                       (ushort)(right<0 ? Audio.MaxVolume : right)));
+      curPos += toRead;
+      return toRead;
+    }
+  }
+
+  protected unsafe override void Dispose(bool finalizing)
+  {
+    lock(this)
+    {
+      if(file!=IntPtr.Zero)
+      {
+        GLMixer.UnmapFile(file);
+        file = IntPtr.Zero;
+        data = null;
+      }
+    }
+    base.Dispose(finalizing);
+  }
+
+  void AssertOpen()
+  {
+    if(file==IntPtr.Zero) throw new ObjectDisposedException("MappedSource");
+  }
+
+  unsafe void Init(ref GLMixer.MapInfo info)
+  {
+    if(file==IntPtr.Zero) SDL.RaiseError();
+    data   = info.data;
+    format = new AudioFormat((int)info.freq, (SampleFormat)info.format, info.channels);
+    Length = (int)(info.bytes/format.FrameSize);
+  }
+
+  internal unsafe byte* Data { get { return data; } }
+
+  const uint ReadAhead = 256*1024;
+  IntPtr file;
+  unsafe byte* data;
+}
+#endregion
+
 #region SoundFileSource
 public class SoundFileSource : AudioSource
 {
@@ -520,6 +900,8 @@ public class SoundFileSource : AudioSource
   {
     SF.Info info = new SF.Info();
     info.format = SF.Format.CPUEndian;
+    path = filename;
+    openInfo = info;
     sndfile = SF.Open(filename, SF.OpenMode.Read, ref info);
     Init(ref info);
   }
@@ -527,6 +909,8 @@ public class SoundFileSource : AudioSource
   {
     SF.Info info = new SF.Info();
     InitInfo(ref info, format);
+    path = filename;
+    openInfo = info;
     sndfile = SF.Open(filename, SF.OpenMode.Read, ref info);
     Init(ref info);
   }
@@ -566,29 +950,69 @@ public class SoundFileSource : AudioSource
     set
     {
       if(value==curPos) return;
-      lock(this) curPos=(int)SF.Seek(sndfile, value, SF.SeekType.Absolute);
+      lock(this)
+      {
+        if(value>=0 && value<prefetched) curPos = value; // the file is seeked when reading passes the prefetched part
+        else filePos = curPos = (int)SF.Seek(sndfile, value, SF.SeekType.Absolute);
+      }
     }
   }
 
+  // the number of frames at the start of the sound that have been decoded by Prefetch
+  public int Prefetched { get { return prefetched; } }
+
+  // decodes the first 'frames' frames of the sound on the audio worker thread and keeps them in memory, so that when
+  // it's played from the start, the mixer doesn't have to wait for the decoder. sounds opened from a file are decoded
+  // through a second handle, so the mixer never waits for the prefetch. sounds read from a stream share the decoder,
+  // so they're decoded in small chunks, each of which holds up the mixer only briefly
+  public void Prefetch(int frames)
+  {
+    if(frames<0) throw new ArgumentOutOfRangeException("frames", "cannot be negative");
+    if(Length>=0 && frames>Length) frames = Length;
+    if(frames>prefetched) Audio.QueueWork(delegate { DoPrefetch(frames); });
+  }
+
   public override int ReadBytes(byte[] buf, int index, int length)
   {
-    int frames = BytesToFrames(length);
+    int frames = BytesToFrames(length), done=0;
     lock(this)
     {
-      int read;
-      unsafe { fixed(byte* pbuf = buf) read=(int)SF.ReadShorts(sndfile, (short*)(pbuf+index), frames); }
-      if(read>=0) curPos += read;
-      return read*Format.FrameSize;
+      if(curPos>=0 && curPos<prefetched)
+      {
+        done = Math.Min(frames, prefetched-curPos);
+        Array.Copy(prefetch, curPos*Format.FrameSize, buf, index, done*Format.FrameSize);
+        curPos += done;
+      }
+      if(done<frames)
+      {
+        int read;
+        if(filePos!=curPos) filePos = curPos = (int)SF.Seek(sndfile, curPos, SF.SeekType.Absolute);
+        unsafe
+        {
+          fixed(byte* pbuf = buf)
+            read = (int)SF.ReadShorts(sndfile, (short*)(pbuf+index+done*Format.FrameSize), frames-done);
+        }
+        if(read>0)
+        {
+          curPos += read;
+          filePos = curPos;
+          done   += read;
+        }
+      }
+      return done*Format.FrameSize;
     }
   }
 
   protected unsafe override void Dispose(bool finalizing)
   {
-    if(sndfile.ToPointer()!=null)
+    lock(this) // a prefetch may be running on the worker thread
     {
-      SF.Close(sndfile);
-      sndfile = new IntPtr(null);
-      Utility.Dispose(ref virtualIO);
+      if(sndfile.ToPointer()!=null)
+      {
+        SF.Close(sndfile);
+        sndfile = new IntPtr(null);
+        Utility.Dispose(ref virtualIO);
+      }
     }
     base.Dispose(finalizing);
   }
@@ -623,8 +1047,61 @@ public class SoundFileSource : AudioSource
     else info.format |= SF.Format.LittleEndian;
   }
 
+  void DoPrefetch(int frames)
+  {
+    if(frames<=prefetched) return;
+    byte[] data = new byte[frames*Format.FrameSize];
+    int read = path!=null ? PrefetchFile(data, frames) : PrefetchShared(data, frames);
+    lock(this)
+    {
+      if(read>prefetched && sndfile!=IntPtr.Zero)
+      {
+        prefetch   = data;
+        prefetched = read;
+      }
+    }
+  }
+
+  // decodes the start of the file through a handle of its own, without holding the lock
+  unsafe int PrefetchFile(byte[] data, int frames)
+  {
+    SF.Info info = openInfo;
+    IntPtr handle = SF.Open(path, SF.OpenMode.Read, ref info);
+    if(handle==IntPtr.Zero) return 0;
+    int read;
+    fixed(byte* pbuf = data) read = (int)SF.ReadShorts(handle, (short*)pbuf, frames);
+    SF.Close(handle);
+    return read;
+  }
+
+  // decodes the start of the stream through the mixer's handle, taking the lock for one chunk at a time
+  unsafe int PrefetchShared(byte[] data, int frames)
+  {
+    int read=0, chunk;
+    while(read<frames)
+    {
+      lock(this)
+      {
+        if(sndfile==IntPtr.Zero) return 0;
+        if(filePos!=read) filePos = (int)SF.Seek(sndfile, read, SF.SeekType.Absolute);
+        fixed(byte* pbuf = data)
+          chunk = (int)SF.ReadShorts(sndfile, (short*)(pbuf+read*Format.FrameSize),
+                                     Math.Min(PrefetchChunk, frames-read));
+        filePos = chunk<0 ? -1 : filePos+chunk; // force a seek on the next read if the decode failed
+      }
+      if(chunk<=0) break;
+      read += chunk;
+    }
+    return read;
+  }
+
+  const int PrefetchChunk = 4096;
   IntPtr sndfile;
   StreamVirtualIO virtualIO;
+  SF.Info openInfo;
+  string path;
+  byte[] prefetch;
+  int filePos, prefetched;
 }
 #endregion
 
@@ -643,14 +1120,20 @@ public class SampleSource : AudioSource
       format = Audio.Format;
     }
     Length = data.Length/Format.FrameSize;
+    BuildSilenceMap();
   }
   public SampleSource(AudioSource stream, AudioFormat convertTo)
   {
     format = convertTo;
     data = Audio.Convert(stream.ReadAll(), stream.Format, format).Shrink();
     Length = data.Length/Format.FrameSize;
+    BuildSilenceMap();
   }
 
+  // the length of the sound up to the end of its last sample that isn't silent. a channel playing the sound for the
+  // last time stops once it reaches this point
+  public int AudibleLength { get { return audibleLength; } }
+
   public override bool CanRewind { get { return true; } }
   public override bool CanSeek { get { return true; } }
   public override int Position
@@ -668,6 +1151,9 @@ public class SampleSource : AudioSource
 
   public override byte[] ReadAll() { return (byte[])data.Clone(); }
 
+  internal byte[] Data { get { return data; } }
+  internal byte[] Silence { get { return silence; } }
+
   public override int ReadBytes(byte[] buf, int index, int length)
   {
     int frames = BytesToFrames(length);
@@ -685,12 +1171,20 @@ public class SampleSource : AudioSource
   {
     lock(this)
     {
-      int toRead=Math.Min(Length-curPos, frames), samples=toRead*Format.Channels;
+      int toRead=Math.Min(Length-curPos, frames), end=curPos+toRead;
       fixed(byte* src = data)
-        GLMixer.Check(GLMixer.ConvertMix(dest, src+curPos*Format.FrameSize, (uint)samples,
-                                         (ushort)Format.Format, Format.Channels,
-                                         (ushort)(left <0 ? Audio.MaxVolume : left),
-                                         (ushort)(right<0 ? Audio.MaxVolume : right)));
+        for(int pos=curPos, next; pos<end; pos=next) // mix runs of audible blocks, and skip silent runs entirely
+        {
+          bool silent = IsSilent(pos/GLMixer.SilenceBlock);
+          next = (pos/GLMixer.SilenceBlock+1)*GLMixer.SilenceBlock;
+          while(next<end && IsSilent(next/GLMixer.SilenceBlock)==silent) next += GLMixer.SilenceBlock;
+          if(next>end) next = end;
+          if(!silent)
+            GLMixer.Check(GLMixer.ConvertMix(dest+(pos-curPos)*Format.Channels, src+pos*Format.FrameSize,
+                                             (uint)((next-pos)*Format.Channels), (ushort)Format.Format,
+                                             Format.Channels, (ushort)(left <0 ? Audio.MaxVolume : left),
+                                             (ushort)(right<0 ? Audio.MaxVolume : right)));
+        }
       curPos += toRead;
       return toRead;
     }
@@ -698,11 +1192,38 @@ public class SampleSource : AudioSource
 
   protected override void Dispose(bool finalizing)
   {
-    data = null;
+    data    = null;
+    silence = null;
     base.Dispose(finalizing);
   }
 
+  // finds the blocks of the sound that are silent, so that they can be skipped while mixing. the samples of a block
+  // that's skipped must be small enough that leaving them out isn't audible
+  unsafe void BuildSilenceMap()
+  {
+    silence = new byte[(Length+GLMixer.SilenceBlock*8-1)/(GLMixer.SilenceBlock*8)];
+    fixed(byte* src = data, map = silence)
+    {
+      audibleLength = GLMixer.BuildSilenceMap(src, (uint)Length, (ushort)Format.Format, Format.Channels,
+                                              SilenceThreshold, map);
+    }
+    if(audibleLength<0) // the format isn't supported, so just don't skip anything
+    {
+      silence       = null;
+      audibleLength = Length;
+    }
+  }
+
+  bool IsSilent(int block)
+  {
+    return silence!=null && (silence[block>>3] & (1<<(block&7)))!=0;
+  }
+
   protected byte[] data;
+  byte[] silence;
+  int audibleLength;
+
+  const ushort SilenceThreshold = 2; // the largest sample (on a 16-bit scale) that counts as silence, about -84dB
 }
 #endregion
 #endregion
@@ -766,6 +1287,9 @@ public class AudioFilter
     get { if(filters==null) filters=new FilterCollection(); return filters; }
   }
 
+  // optional filters are skipped when the mixer is overloaded
+  public bool Optional { get; set; }
+
   public virtual void Stop(Channel channel)
   {
     if(filters!=null) foreach(AudioFilter filter in filters) filter.Stop(channel);
@@ -895,6 +1419,63 @@ public class BiquadFilter : AudioFilter
 }
 #endregion
 
+#region MatrixFilter
+// remixes the channels of the sound through a gain matrix, where Matrix[d*channels+s] is the gain from channel s to
+// channel d. this covers channel swapping, stereo widening, mid/side processing and so on
+public class MatrixFilter : AudioFilter
+{
+  public MatrixFilter() { }
+  public MatrixFilter(params float[] matrix) { Matrix = matrix; }
+
+  public float[] Matrix
+  {
+    get { return matrix; }
+    set
+    {
+      int channels = value==null ? 0 : (int)Math.Round(Math.Sqrt(value.Length));
+      if(value!=null && (channels*channels!=value.Length || channels==0 || channels>8))
+        throw new ArgumentException("The matrix must be square, for up to 8 channels.");
+      matrix = value;
+    }
+  }
+
+  // swaps the left and right channels of a stereo sound
+  public static MatrixFilter Swap() { return new MatrixFilter(0, 1, 1, 0); }
+
+  // scales the difference between the channels of a stereo sound. 0 makes it mono, 1 leaves it unchanged, and greater
+  // values widen it
+  public static MatrixFilter Widen(float width)
+  {
+    float same = (1+width)*0.5f, other = (1-width)*0.5f;
+    return new MatrixFilter(same, other, other, same);
+  }
+
+  // converts a stereo sound to mid/side (in the left and right channels), or back again
+  public static MatrixFilter ToMidSide() { return new MatrixFilter(0.5f, 0.5f, 0.5f, -0.5f); }
+  public static MatrixFilter FromMidSide() { return new MatrixFilter(1, 1, 1, -1); }
+
+  [CLSCompliant(false)]
+  internal protected unsafe override void MixFilter(Channel channel, int* buffer, int frames, AudioFormat format)
+  {
+    float[] matrix = this.matrix;
+    if(matrix==null || matrix.Length!=format.Channels*format.Channels)
+    {
+      base.MixFilter(channel, buffer, frames, format);
+      return;
+    }
+
+    int samples = frames*format.Channels;
+    int* src = stackalloc int[samples];
+    Unsafe.Copy(buffer, src, samples*sizeof(int));
+    Unsafe.Clear(buffer, samples*sizeof(int));
+    Audio.MatrixMix(buffer, format.Channels, src, format.Channels, frames, matrix);
+    if(Filters.Count!=0) base.MixFilter(channel, buffer, frames, format);
+  }
+
+  float[] matrix;
+}
+#endregion
+
 #region EqFilter
 public enum EqFilterType
 {
@@ -1098,18 +1679,59 @@ public sealed class Channel
 
   public event ChannelFinishedHandler Finished;
 
-  public int Age { get { return source==null ? 0 : (int)(Timing.Milliseconds-startTime); } }
-
-  public int Both
+  // the channel's ADSR envelope, or null if it has none. it applies to the current sound and the ones after it
+  public unsafe AdsrEnvelope? Adsr
   {
-    get { return left; }
-    set { Audio.CheckVolume(value); left = right = value; }
-  }
+    get { return adsr; }
+    set
+    {
+      lock(this)
+      {
+        adsr = value;
+        ApplyAdsr();
+      }
+    }
+  }
+
+  public int Age { get { return source==null ? 0 : (int)(Timing.Milliseconds-startTime); } }
+
+  public int Both
+  {
+    get { return left; }
+    set { Audio.CheckVolume(value); left = right = value; }
+  }
+
+  // the submix bus that the channel plays through, or 0 to mix directly into the output
+  public int Bus
+  {
+    get { return bus; }
+    set
+    {
+      if(value<0) throw new ArgumentOutOfRangeException("Bus", "cannot be negative");
+      bus = value;
+    }
+  }
 
   public Fade Fading { get { return fade; } }
 
   public FilterCollection Filters { get { if(filters==null) filters=new FilterCollection(this); return filters; } }
 
+  // a handle to the sound currently playing on the channel, which goes stale when it stops
+  public VoiceHandle Handle { get { return new VoiceHandle(handle); } }
+
+  // the cutoff frequencies of the channel's built-in one-pole filters, in Hz, or zero if disabled. these are much
+  // cheaper than an EqFilter, and are meant for muffling occluded sounds
+  public int HighPassCutoff
+  {
+    get { return highPass; }
+    set { SetCutoffs(lowPass, value); }
+  }
+  public int LowPassCutoff
+  {
+    get { return lowPass; }
+    set { SetCutoffs(value, highPass); }
+  }
+
   public int Left
   {
     get { return left; }
@@ -1120,9 +1742,33 @@ public sealed class Channel
   public bool Paused { get { return paused; } set { paused=value; } }
   public float PlaybackRate { get { return rate; } set { Audio.CheckRate(rate); lock(this) rate=value; } }
   public bool Playing { get { return Status==ChannelStatus.Playing; } }
-  public int Position { get { return position; } set { lock(this) position=value; } }
+  public int Position
+  {
+    get { return position; }
+    set
+    {
+      lock(this)
+      {
+        position=value;
+        if(streamCvt!=IntPtr.Zero) GLMixer.Check(GLMixer.ResetStream(streamCvt));
+      }
+    }
+  }
   public int Priority { get { return priority; } }
 
+  // the level of detail to mix the channel at, or Auto to choose one from the volume and priority each buffer
+  public AudioDetail LevelOfDetail
+  {
+    get { return lod; }
+    set
+    {
+      if(value<AudioDetail.Auto || value>AudioDetail.Minimal) throw new ArgumentOutOfRangeException("LevelOfDetail");
+      lod = value;
+    }
+  }
+  // the level of detail used to mix the last buffer
+  public AudioDetail CurrentDetail { get { return currentDetail; } }
+
   public int Right
   {
     get { return right; }
@@ -1155,11 +1801,46 @@ public sealed class Channel
   public void GetVolume(out int left, out int right) { left=this.left; right=this.right; }
   public void SetVolume(int left, int right) { Left=left; Right=right; }
 
+  // submits an envelope for one of the channel's parameters, which the mixer follows sample by sample from the next
+  // buffer on, so the game doesn't need to update it every frame. volume is a gain from 0 to 1 on top of the channel's
+  // volume, pan goes from -1 (left) to 1 (right), and rate multiplies the playback rate (up to 16). the last value is
+  // held after the envelope ends. automation is removed when the channel starts another sound
+  public unsafe void Automate(AutomationParameter param, params Breakpoint[] points)
+  {
+    if(points==null) throw new ArgumentNullException("points");
+    lock(this)
+      fixed(Breakpoint* p = points)
+        GLMixer.Check(GLMixer.SetVoiceAutomation(handle, param, p, (uint)points.Length));
+  }
+  public void ClearAutomation(AutomationParameter param) { Automate(param); }
+
   public void Pause() { paused=true; }
   public void Resume() { paused=false; }
   public void Stop() { lock(this) StopPlaying(); }
 
-  internal void Reset() { rate=1f; left=Audio.MaxVolume; right=Audio.MaxVolume; }
+  // restarts the attack of the channel's ADSR envelope, or starts its release, without waiting for the mixer
+  public void NoteOn() { Handle.NoteOn(); }
+  public void NoteOff() { Handle.NoteOff(); }
+
+  public void SetCutoffs(int lowPass, int highPass)
+  {
+    if(lowPass<0) throw new ArgumentOutOfRangeException("lowPass", "cannot be negative");
+    if(highPass<0) throw new ArgumentOutOfRangeException("highPass", "cannot be negative");
+    lock(this)
+    {
+      GLMixer.Check(GLMixer.SetVoiceFilter(handle, (uint)lowPass, (uint)highPass));
+      this.lowPass  = lowPass;
+      this.highPass = highPass;
+      if(lowPass!=0 || highPass!=0) voiceFilter = true; // otherwise, let Mix clear it once the filters settle
+    }
+  }
+
+  internal void Reset()
+  {
+    rate=1f; left=Audio.MaxVolume; right=Audio.MaxVolume;
+    if(lowPass!=0 || highPass!=0) SetCutoffs(0, 0);
+    if(adsr!=null) Adsr = null;
+  }
 
   internal void StartPlaying(AudioSource source, int loops, int position, Fade fade, int fadeMs, int timeoutMs)
   {
@@ -1180,13 +1861,15 @@ public sealed class Channel
       paused    = false;
       startTime = Timing.Milliseconds;
       source.playing++;
-      convert = !source.Format.Equals(Audio.Format);
-      if(convert)
-      {
-        GLMixer.AudioConversion cvt = Audio.SetupConversion(source.Format, Audio.Format);
-        sdMul=cvt.lenMul; sdDiv=cvt.lenDiv;
-      }
-      else convBuf=null;
+      handle = GLMixer.AcquireVoice((uint)number);
+      if(handle==0) SDL.RaiseError();
+      // the native settings only change through a current handle, so give the new sound the channel's settings
+      GLMixer.Check(GLMixer.SetVoiceFilter(handle, (uint)lowPass, (uint)highPass));
+      ApplyAdsr();
+      GLMixer.Check(GLMixer.ResetVoice((uint)number));
+      voiceFilter = lowPass!=0 || highPass!=0;
+      FreeStreamConverter();
+      if(!NeedsConversion(Audio.Format.Frequency)) convBuf=mixBuf=null;
       if(fade!=Fade.None)
       {
         fadeTime  = (uint)fadeMs;
@@ -1206,20 +1889,34 @@ public sealed class Channel
       Audio.OnFiltersFinished(this);
       if(Finished!=null) Finished(this);
       Audio.OnChannelFinished(this);
+      FreeStreamConverter();
+      GLMixer.ReleaseVoice((uint)number);
       source = null;
     }
   }
 
-  internal unsafe void Mix(int* stream, int frames, FilterCollection filters)
+  // mixes 'frames' frames into the stream, which runs at 'outRate' (the output rate, or the rate of the channel's bus)
+  internal unsafe void Mix(int* stream, int frames, int outRate, FilterCollection filters)
   {
     if(source==null || paused) return;
     lock(source)
     {
       if(source.Length==0) return;
+      if(virtualized) // the channel was skipped while the mixer was overloaded, so fade it back in
+      {
+        virtualized = false;
+        if(fade==Fade.None)
+        {
+          fade      = Fade.In;
+          fadeTime  = ResumeFadeMs;
+          fadeLeft  = fadeRight = 0;
+          fadeStart = Timing.Milliseconds;
+        }
+      }
       AudioFormat format = source.Format;
       float rate = EffectiveRate;
       int left = EffectiveLeft, right=EffectiveRight, read, toRead, samples;
-      bool convert = this.convert;
+      bool convert = NeedsConversion(outRate);
 
       if(timeout!=Audio.Infinite && Age>timeout)
       {
@@ -1241,37 +1938,48 @@ public sealed class Channel
         }
         else
         {
-          left  = fadeLeft  + (ltarg-fadeLeft)*(int)fadeSoFar/(int)fadeTime;
-          right = fadeRight + (rtarg-fadeRight)*(int)fadeSoFar/(int)fadeTime;
+          left  = fadeLeft  + (int)((long)(ltarg-fadeLeft)*fadeSoFar/fadeTime);
+          right = fadeRight + (int)((long)(rtarg-fadeRight)*fadeSoFar/fadeTime);
         }
       }
 
+      AudioDetail detail = lod!=AudioDetail.Auto ? lod :
+        (AudioDetail)GLMixer.SelectLod((ushort)Math.Min(left, 256), (ushort)Math.Min(right, 256), priority);
+      currentDetail = detail;
+      if(detail>=AudioDetail.Low) filters = null; // distant voices bypass the filters
+      FilterCollection myFilters = detail>=AudioDetail.Low ? null : this.filters;
+
       if(source.CanSeek) source.Position = position;
-      if(convert || rate!=1f) // FIXME: this path can result in 'toRead' not being a frame multiple!!!
+      if(convert || rate!=1f)
       {
-        int index=0, mustWrite = frames*Audio.Format.FrameSize, framesRead;
+        int index=0, frameSize = Audio.Format.FrameSize, mustWrite = frames*frameSize, written, framesRead;
         bool stop=false;
-        if(rate==1f) toRead = (int)((long)mustWrite*sdDiv/sdMul);
-        else
+        if(rate!=1f)
         {
-          int shift = format.FrameSize>>1;
           format.Frequency = (int)(format.Frequency*rate);
           if(format.Frequency==0) return;
-          convert = true;
-          GLMixer.AudioConversion cvt = Audio.SetupConversion(format, Audio.Format);
-          toRead = (int)((long)mustWrite*cvt.lenDiv/cvt.lenMul+shift)>>shift<<shift;
         }
 
-        // FIXME: HACK: this hacks the 'toRead' not frame multiple problem by duplicating samples
-        // this means it's possible that a few samples may be added each buffer fill. this is not correct output!
-        if(format.FrameSize>1)
+        // the stream converter carries partial frames and resampler history between calls, so we can read exactly
+        // the amount of data needed to produce the buffer. it always produces the output channel count, so that
+        // changes in the level of detail don't throw away the frames it has buffered
+        if(streamCvt!=IntPtr.Zero && streamRate!=outRate) FreeStreamConverter();
+        if(streamCvt==IntPtr.Zero)
         {
-          int diff = toRead & (format.FrameSize-1);
-          if(diff>0) toRead += format.FrameSize-diff;
+          streamCvt = GLMixer.CreateStreamConverter(format.Frequency, (ushort)format.Format, format.Channels,
+                                                    outRate, (ushort)Audio.Format.Format, Audio.Format.Channels);
+          if(streamCvt==IntPtr.Zero) SDL.RaiseError();
+          streamRate = outRate;
         }
+        else GLMixer.Check(GLMixer.SetStreamRate(streamCvt, format.Frequency));
+        GLMixer.Check(GLMixer.SetStreamQuality(streamCvt,
+          detail==AudioDetail.Minimal || Audio.LoadLevel>=AudioLoadLevel.LowQuality ? GLMixer.Quality.Low :
+          detail==AudioDetail.Full ? GLMixer.Quality.High : GLMixer.Quality.Normal));
 
-        int len = Math.Max(toRead, mustWrite);
-        if(convBuf==null || convBuf.Length<len) convBuf = new byte[len];
+        toRead = GLMixer.StreamInputSize(streamCvt, (uint)frames);
+        GLMixer.Check(toRead);
+        if(convBuf==null || convBuf.Length<toRead) convBuf = new byte[toRead];
+        if(mixBuf==null || mixBuf.Length<mustWrite) mixBuf = new byte[mustWrite];
 
         while(index<toRead)
         {
@@ -1280,7 +1988,6 @@ public sealed class Channel
           {
             if(loops==0)
             {
-              Array.Clear(convBuf, index, toRead-index);
               stop = true;
               break;
             }
@@ -1293,26 +2000,49 @@ public sealed class Channel
           }
           index += read;
         }
-        SizedArray sa = Audio.Convert(convBuf, format, Audio.Format, toRead, mustWrite);
-        if(sa.Array!=convBuf) convBuf = sa.Array;
-        framesRead = sa.Length/Audio.Format.FrameSize;
+        fixed(byte* src = convBuf, dest = mixBuf)
+        {
+          written = GLMixer.StreamConvert(streamCvt, src, (uint)index, dest, (uint)mustWrite);
+          GLMixer.Check(written);
+          if(stop)
+          {
+            int flushed = GLMixer.StreamFlush(streamCvt, dest+written, (uint)(mustWrite-written));
+            GLMixer.Check(flushed);
+            written += flushed;
+          }
+        }
+        framesRead = written/frameSize;
         samples    = framesRead*Audio.Format.Channels;
-        if((this.filters==null || this.filters.Count==0) && (filters==null || filters.Count==0))
-          fixed(byte* src = convBuf)
+        if(detail==AudioDetail.Minimal && Audio.Format.Channels==2 && !voiceFilter && !automated)
+        {
+          // minimal detail mixes the channel in mono, downmixing and panning it with one matrix pass
+          int* buffer = stackalloc int[samples];
+          int* matrix = stackalloc int[4]; // 16.16 gains, from volumes of 0-256 halved for the downmix
+          matrix[0] = matrix[1] = left*128;
+          matrix[2] = matrix[3] = right*128;
+          Unsafe.Clear(buffer, samples*sizeof(int));
+          fixed(byte* src = mixBuf)
+            GLMixer.Check(GLMixer.ConvertMix(buffer, src, (uint)samples, (ushort)Audio.Format.Format,
+                                             Audio.Format.Channels, (ushort)Audio.MaxVolume, (ushort)Audio.MaxVolume));
+          GLMixer.Check(GLMixer.MatrixMixFixed(stream, 2, buffer, 2, (uint)framesRead, matrix));
+        }
+        else if(!voiceFilter && !automated && (myFilters==null || myFilters.Count==0) &&
+                (filters==null || filters.Count==0))
+          fixed(byte* src = mixBuf)
             GLMixer.Check(GLMixer.ConvertMix(stream, src, (uint)samples, (ushort)Audio.Format.Format,
                                              Audio.Format.Channels, (ushort)left, (ushort)right));
         else
         {
           int* buffer = stackalloc int[samples];
           Unsafe.Clear(buffer, samples*sizeof(int));
-          fixed(byte* src = convBuf)
+          fixed(byte* src = mixBuf)
             GLMixer.Check(GLMixer.ConvertMix(buffer, src, (uint)samples,
                                              (ushort)Audio.Format.Format, Audio.Format.Channels,
                                              (ushort)Audio.MaxVolume, (ushort)Audio.MaxVolume));
-          if(this.filters!=null)
-            for(int i=0; i<this.filters.Count; i++) this.filters[i].MixFilter(this, buffer, framesRead, Audio.Format);
-          if(filters!=null)
-            for(int i=0; i<filters.Count; i++) filters[i].MixFilter(this, buffer, framesRead, Audio.Format);
+          Audio.MixFilters(myFilters, this, buffer, framesRead, Audio.Format);
+          Audio.MixFilters(filters, this, buffer, framesRead, Audio.Format);
+          if(voiceFilter) FilterVoice(buffer, framesRead);
+          if(automated) GLMixer.Check(GLMixer.AutomateVoice((uint)number, buffer, 0, (uint)framesRead));
           GLMixer.Check(GLMixer.Mix(stream, buffer, (uint)samples, (ushort)left, (ushort)right));
         }
 
@@ -1323,22 +2053,25 @@ public sealed class Channel
         toRead=frames;
         while(true)
         {
-          if((this.filters==null || this.filters.Count==0) && (filters==null || filters.Count==0))
+          if(!voiceFilter && !automated && (myFilters==null || myFilters.Count==0) &&
+             (filters==null || filters.Count==0))
           {
             read    = source.ReadFrames(stream, toRead, left, right);
             samples = read*Audio.Format.Channels;
           }
           else
           {
-            int* buffer = stackalloc int[toRead];
-            Unsafe.Clear(buffer, toRead*sizeof(int));
+            int* buffer = stackalloc int[toRead*Audio.Format.Channels];
+            Unsafe.Clear(buffer, toRead*Audio.Format.Channels*sizeof(int));
             read    = source.ReadFrames(buffer, toRead, -1, -1);
             samples = read*Audio.Format.Channels;
             if(read>0)
             {
-              if(this.filters!=null)
-                for(int i=0; i<this.filters.Count; i++) this.filters[i].MixFilter(this, buffer, read, format);
-              if(filters!=null) for(int i=0; i<filters.Count; i++) filters[i].MixFilter(this, buffer, read, format);
+              Audio.MixFilters(myFilters, this, buffer, read, format);
+              Audio.MixFilters(filters, this, buffer, read, format);
+              if(voiceFilter) FilterVoice(buffer, read);
+              if(automated)
+                GLMixer.Check(GLMixer.AutomateVoice((uint)number, buffer, (uint)(frames-toRead), (uint)read));
               GLMixer.Check(GLMixer.Mix(stream, buffer, (uint)samples, (ushort)left, (ushort)right));
             }
           }
@@ -1358,22 +2091,145 @@ public sealed class Channel
         }
       }
       position = source.Position;
+
+      // a sound playing for the last time can stop as soon as only silence remains
+      SampleSource sample = source as SampleSource;
+      if(!convert && rate==1f && loops==0 && sample!=null && position>=sample.AudibleLength) StopPlaying();
+    }
+  }
+
+  // returns whether the channel can be mixed by summing its gains with other channels playing the same sample from the
+  // same position, ie, whether it will simply mix the next 'frames' frames of the sample unchanged
+  internal bool CanShareRead(int frames, int outRate, FilterCollection filters)
+  {
+    SampleSource sample = source as SampleSource;
+    return sample!=null && !paused && !virtualize && !virtualized && fade==Fade.None && !NeedsConversion(outRate) &&
+           !voiceFilter &&
+           !automated && timeout==Audio.Infinite && EffectiveRate==1f && position+frames<=sample.AudibleLength &&
+           (this.filters==null || this.filters.Count==0) && (filters==null || filters.Count==0);
+  }
+
+  // queues the sample to be mixed by Audio.MixBatch with the summed gains of this channel and the channels sharing its
+  // read, and advances the channel past it
+  internal unsafe void QueueShared(int* stream, int frames, int left, int right)
+  {
+    lock(source)
+    {
+      SampleSource sample = (SampleSource)source;
+      Audio.QueueVoice(sample, position, stream, frames, left, right);
+      position += frames;
+      if(loops==0 && position>=sample.AudibleLength) StopPlaying();
     }
   }
 
-  int EffectiveLeft { get { int v=source.Left; return v==Audio.MaxVolume ? left  : (left *v)>>8; } }
-  int EffectiveRight { get { int v=source.Right; return v==Audio.MaxVolume ? right : (right*v)>>8; } }
-  float EffectiveRate { get { return source.PlaybackRate*rate; } }
+  // returns whether the source must be converted to be mixed into a stream at the given rate in the output format
+  bool NeedsConversion(int outRate)
+  {
+    AudioFormat f = source.Format;
+    return f.Frequency!=outRate || f.Format!=Audio.Format.Format || f.Channels!=Audio.Format.Channels;
+  }
+
+  // advances the channel past a buffer that another channel mixed for it
+  internal void SkipShared(int frames) { position += frames; }
+
+  // advances the channel without mixing it, returning false if the source can't be skipped
+  internal bool Skip(int frames)
+  {
+    if(source==null || paused) return true;
+    lock(source)
+    {
+      int length = source.Length;
+      if(!source.CanSeek || length<=0) return false;
+      if(timeout!=Audio.Infinite && Age>timeout || fade==Fade.Out && Timing.Milliseconds-fadeStart>fadeTime)
+      {
+        StopPlaying();
+        return true;
+      }
+
+      position += (int)(frames*EffectiveRate*source.Format.Frequency/Audio.Format.Frequency);
+      for(; position>=length; position-=length)
+      {
+        if(loops==0) { StopPlaying(); return true; }
+        if(loops!=Audio.Infinite) loops--;
+      }
+      if(streamCvt!=IntPtr.Zero) GLMixer.Check(GLMixer.ResetStream(streamCvt));
+      virtualized = true;
+      return true;
+    }
+  }
+
+  internal int EffectiveLeft
+  {
+    get { int v=(source.Left*source.normVolume>>8)*controlVolume>>8; return v==Audio.MaxVolume ? left  : (left *v)>>8; }
+  }
+  internal int EffectiveRight
+  {
+    get { int v=(source.Right*source.normVolume>>8)*controlVolume>>8; return v==Audio.MaxVolume ? right : (right*v)>>8; }
+  }
+  float EffectiveRate { get { return source.PlaybackRate*rate*autoRate; } }
+
+  // acts on the group and handle commands that the mixer applied to the channel's native voice for this buffer, and
+  // picks up the voice's automation
+  internal unsafe void ApplyControl(GLMixer.VoiceControl* control)
+  {
+    controlVolume = control->volume;
+    autoRate      = control->rate;
+    automated     = (control->automation & GLMixer.VoiceControl.GainAutomation)!=0;
+    if(control->flags==0) return;
+    if((control->flags & GLMixer.VoiceControl.Pause)!=0) paused = true;
+    if((control->flags & GLMixer.VoiceControl.Resume)!=0) paused = false;
+    if((control->flags & GLMixer.VoiceControl.FadeOut)!=0) FadeOut((int)control->fadeMs);
+    if((control->flags & GLMixer.VoiceControl.Stop)!=0) StopPlaying();
+  }
+
+  // gives the native voice the channel's ADSR envelope, if the channel is playing a sound
+  unsafe void ApplyAdsr()
+  {
+    if(adsr==null) GLMixer.Check(GLMixer.SetVoiceAdsr(handle, null));
+    else
+    {
+      AdsrEnvelope env = adsr.Value;
+      GLMixer.Check(GLMixer.SetVoiceAdsr(handle, &env));
+    }
+  }
+
+  unsafe void FilterVoice(int* buffer, int frames)
+  {
+    int active = GLMixer.FilterVoice((uint)number, buffer, (uint)frames);
+    GLMixer.Check(active);
+    if(active==0 && lowPass==0 && highPass==0) voiceFilter = false;
+  }
+
+  void FreeStreamConverter()
+  {
+    if(streamCvt!=IntPtr.Zero)
+    {
+      GLMixer.FreeStreamConverter(streamCvt);
+      streamCvt = IntPtr.Zero;
+    }
+  }
 
   AudioSource source;
   FilterCollection filters;
-  byte[] convBuf;
-  float rate=1f;
+  byte[] convBuf, mixBuf;
+  IntPtr streamCvt;
+  float rate=1f, autoRate=1f;
+  AudioDetail lod=AudioDetail.Auto, currentDetail;
+  AdsrEnvelope? adsr;
   uint startTime, fadeStart, fadeTime;
   int left=Audio.MaxVolume, right=Audio.MaxVolume, fadeLeft, fadeRight;
-  int timeout, number, position, loops, priority, sdMul, sdDiv;
+  int timeout, number, position, loops, priority, lowPass, highPass, bus, streamRate, controlVolume=Audio.MaxVolume;
+  uint handle;
+  internal int groups;
   Fade fade;
-  bool paused, convert;
+  bool paused, virtualized, voiceFilter, automated;
+  internal bool virtualize;
+  // the next channel in the group sharing this one's read (or -1), whether this channel leads a group, and whether
+  // it's already been mixed this buffer as part of another channel's group
+  internal int sharedNext;
+  internal bool sharedLead, sharedDone;
+
+  const int ResumeFadeMs = 20;
 }
 #endregion
 
@@ -1396,6 +2252,32 @@ public static class Audio
 
   public static bool Initialized { get { return init; } }
   public static AudioFormat Format { get { AssertInit(); return format; } }
+  public static AudioOutput Output { get { AssertInit(); return output; } }
+
+  public static AudioLoadLevel LoadLevel { get { return loadLevel; } }
+
+  // the fraction of the buffer period that mixing may take before the mixer starts to degrade the output to keep up.
+  // zero disables degradation
+  public static float LoadBudget
+  {
+    get { AssertInit(); return GLMixer.GetLoadBudget()/1000f; }
+    set
+    {
+      AssertInit();
+      if(value<0 || value>65) throw new ArgumentOutOfRangeException("LoadBudget");
+      GLMixer.SetLoadBudget((ushort)(value*1000));
+    }
+  }
+
+  // sets the scores below which automatic level of detail drops to Reduced, Low and Minimal. a channel's score is its
+  // louder volume plus its priority times the priority weight
+  public static void SetDetailThresholds(int reduced, int low, int minimal, int priorityWeight)
+  {
+    AssertInit();
+    if(reduced<low || low<minimal || minimal<0 || reduced>ushort.MaxValue)
+      throw new ArgumentException("Thresholds must be non-negative and in decreasing order");
+    GLMixer.SetLodThresholds((ushort)reduced, (ushort)low, (ushort)minimal, priorityWeight);
+  }
   public static object SyncRoot { get { AssertInit(); return callback; } }
 
   public static int MasterVolume
@@ -1423,21 +2305,29 @@ public static class Audio
   public static bool Initialize(int frequency) { return Initialize(frequency, SampleFormat.Default, Speakers.Stereo, 50); }
   public static bool Initialize(int frequency, SampleFormat format) { return Initialize(frequency, format, Speakers.Stereo, 50); }
   public static bool Initialize(int frequency, SampleFormat format, Speakers chans) { return Initialize(frequency, format, chans, 50); }
-  public unsafe static bool Initialize(int frequency, SampleFormat format, Speakers chans, int bufferMs)
+  public static bool Initialize(int frequency, SampleFormat format, Speakers chans, int bufferMs)
+  {
+    return Initialize(frequency, format, chans, bufferMs, AudioOutput.Sdl, null);
+  }
+  public unsafe static bool Initialize(int frequency, SampleFormat format, Speakers chans, int bufferMs,
+                                       AudioOutput output, string path)
   {
     if(frequency < 0 || bufferMs < 0) throw new ArgumentOutOfRangeException();
     if(init) throw new InvalidOperationException("Already initialized. Deinitialize first to change format");
     if((format&SampleFormat.FloatingPoint)!=0)
       throw new ArgumentException("Floating point format not supported by the underlying API.", "format");
+    if(output==AudioOutput.WaveFile && path==null) throw new ArgumentNullException("path");
 
     callback    = new GLMixer.MixCallback(FillBuffer);
-    groups      = new List<List<int>>();
-    SDL.Initialize(SDL.InitFlag.Audio);
+    Audio.output = output;
+    // the null and wave file outputs don't need the audio device
+    if(output==AudioOutput.Sdl) SDL.Initialize(SDL.InitFlag.Audio);
     init        = true;
 
     try
     {
-      GLMixer.Check(GLMixer.Init((uint)frequency, (ushort)format, (byte)chans, (uint)bufferMs, callback, new IntPtr(null)));
+      GLMixer.Check(GLMixer.Init((uint)frequency, (ushort)format, (byte)chans, (uint)bufferMs, callback, new IntPtr(null),
+                                 (GLMixer.Backend)output, path));
 
       uint freq, bytes;
       ushort form;
@@ -1448,7 +2338,7 @@ public static class Audio
       if(filters!=null) filters.LockObj = callback;
       if(postFilters!=null) postFilters.LockObj = callback;
 
-      SDL.PauseAudio(0);
+      GLMixer.PauseAudio(0);
       return freq==frequency && form==(short)format && chan==(byte)chans;
     }
     catch { Deinitialize(); throw; }
@@ -1458,26 +2348,269 @@ public static class Audio
   {
     if(init)
     {
-      SDL.PauseAudio(1);
+      GLMixer.PauseAudio(1);
       lock(callback)
       {
         Stop();
         if(postFilters!=null) for(int i=0; i<postFilters.Count; i++) postFilters[i].Stop(null);
         GLMixer.Quit();
-        SDL.Deinitialize(SDL.InitFlag.Audio);
+        if(output==AudioOutput.Sdl) SDL.Deinitialize(SDL.InitFlag.Audio);
         callback = null;
         chans    = new Channel[0];
-        groups   = null;
+        usedGroups = 0;
         init     = false;
       }
     }
   }
 
+  // sets the directory where LoadCached keeps decoded sounds, and the cache's maximum size in bytes. the least
+  // recently used sounds are deleted when it grows past the limit. a null directory disables the cache
+  public static void SetDecodeCache(string directory, long maxBytes)
+  {
+    if(maxBytes<0) throw new ArgumentOutOfRangeException("maxBytes", "cannot be negative");
+    GLMixer.Check(GLMixer.SetCacheDirectory(directory, (ulong)maxBytes));
+    decodeCache = directory!=null;
+  }
+
+  // loads a sound file (eg, Ogg or FLAC) decoded to the mixer's format. when the decode cache is enabled, the decoded
+  // sound is written to the cache, and later loads memory-map it from there instead of decoding the file again. the
+  // cache is keyed by the file's contents, so a changed file is decoded again
+  public static unsafe AudioSource LoadCached(string filename)
+  {
+    AssertInit();
+    if(filename==null) throw new ArgumentNullException("filename");
+
+    // cache entries are WAV files, which can only hold the 8-bit unsigned and 16-bit little-endian formats
+    bool cacheable = decodeCache && (format.Format==SampleFormat.U8 || format.Format==SampleFormat.S16);
+    ulong hash = 0;
+    if(cacheable)
+    {
+      StringBuilder path = new StringBuilder(1024);
+      GLMixer.Check(GLMixer.HashFile(filename, out hash));
+      int found = GLMixer.CacheLookup(hash, (uint)format.Frequency, (ushort)format.Format, format.Channels, path,
+                                      (uint)path.Capacity);
+      GLMixer.Check(found);
+      if(found!=0) return new MappedSource(path.ToString());
+    }
+
+    SampleSource source;
+    using(SoundFileSource file = new SoundFileSource(filename)) source = new SampleSource(file, true);
+    if(cacheable) // a failure to store the sound (eg, because the disk is full) isn't fatal
+      fixed(byte* data = source.Data)
+        GLMixer.CacheStore(hash, (uint)format.Frequency, (ushort)format.Format, format.Channels, data,
+                           (uint)source.Data.Length);
+    return source;
+  }
+
+  // measures the loudness and true peak of a batch of sounds, in parallel, and computes the gain that would bring each
+  // one to the target loudness (eg, -23 LUFS) without its true peak exceeding -1 dBTP. if 'normalize' is true, the
+  // gains are also assigned to the sources' Normalization properties. the results can be stored along with the sounds,
+  // so that they needn't be analyzed every time they're loaded
+  public static unsafe LoudnessInfo[] AnalyzeLoudness(float targetLufs, bool normalize, params AudioSource[] sources)
+  {
+    if(sources==null) throw new ArgumentNullException("sources");
+    GLMixer.LoudnessJob[] jobs = new GLMixer.LoudnessJob[sources.Length];
+    GCHandle[] pins = new GCHandle[sources.Length];
+    try
+    {
+      for(int i=0; i<sources.Length; i++)
+      {
+        AudioSource source = sources[i];
+        if(source==null) throw new ArgumentException("A source was null.");
+        if(source.Length<0) throw new ArgumentException("Infinite sources can't be analyzed.");
+        MappedSource mapped = source as MappedSource;
+        if(mapped!=null) jobs[i].data = mapped.Data;
+        else
+        {
+          SampleSource sample = source as SampleSource;
+          pins[i] = GCHandle.Alloc(sample!=null ? sample.Data : source.ReadAll(), GCHandleType.Pinned);
+          jobs[i].data = (void*)pins[i].AddrOfPinnedObject();
+        }
+        jobs[i].frames   = (uint)source.Length;
+        jobs[i].freq     = (uint)source.Format.Frequency;
+        jobs[i].format   = (ushort)source.Format.Format;
+        jobs[i].channels = source.Format.Channels;
+      }
+      fixed(GLMixer.LoudnessJob* pjobs = jobs)
+        GLMixer.Check(GLMixer.AnalyzeLoudness(pjobs, (uint)jobs.Length, targetLufs, -1f,
+                                              (uint)Environment.ProcessorCount));
+    }
+    finally
+    {
+      for(int i=0; i<pins.Length; i++) if(pins[i].IsAllocated) pins[i].Free();
+    }
+
+    LoudnessInfo[] info = new LoudnessInfo[jobs.Length];
+    for(int i=0; i<jobs.Length; i++)
+    {
+      info[i].Loudness = jobs[i].loudness;
+      info[i].TruePeak = jobs[i].truePeak;
+      info[i].Gain     = jobs[i].gain;
+      if(normalize) sources[i].Normalization = jobs[i].gain;
+    }
+    return info;
+  }
+
+  // runs a job on the audio worker thread, which is started when it's first needed and runs under the
+  // AudioThread.Worker policy
+  internal static void QueueWork(ThreadStart job)
+  {
+    lock(workQueue)
+    {
+      workQueue.Enqueue(job);
+      if(worker==null)
+      {
+        worker = new Thread(WorkerThread);
+        worker.IsBackground = true;
+        worker.Name = "Audio worker";
+        worker.Start();
+      }
+      Monitor.Pulse(workQueue);
+    }
+  }
+
+  static void WorkerThread()
+  {
+    uint policy = 0;
+    while(true)
+    {
+      ThreadStart job;
+      lock(workQueue)
+      {
+        while(workQueue.Count==0) Monitor.Wait(workQueue);
+        job = workQueue.Dequeue();
+      }
+      try
+      {
+        GLMixer.Check(GLMixer.UpdateThreadPolicy((int)AudioThread.Worker, ref policy));
+        job();
+      }
+      catch(Exception e)
+      {
+        if(Events.Events.Initialized)
+          try { Events.Events.PushEvent(new Events.ExceptionEvent(Events.ExceptionLocation.AudioThread, e)); }
+          catch { }
+      }
+    }
+  }
+
+  // the policy is applied by the threads themselves the next time they run, since the mixer thread belongs to SDL.
+  // realtime schedules fall back to the highest normal priority if the process isn't allowed to use them. worker
+  // threads do offline work (prefetching, analysis, and recording) and can only use the Normal schedule
+  public static void SetThreadPolicy(AudioThread thread, AudioThreadPolicy policy)
+  {
+    GLMixer.ThreadPolicy native = new GLMixer.ThreadPolicy();
+    native.policy   = (int)policy.Schedule;
+    native.priority = policy.Priority;
+    native.affinity = (ulong)policy.Affinity;
+    GLMixer.Check(GLMixer.SetThreadPolicy((int)thread, ref native));
+  }
+
+  // retrieves the policy actually in effect for the given thread, and returns false if the latest policy has not
+  // been applied yet
+  public static bool GetThreadPolicy(AudioThread thread, out AudioThreadPolicy effective)
+  {
+    GLMixer.ThreadPolicy requested, native;
+    int applied = GLMixer.GetThreadPolicy((int)thread, out requested, out native);
+    GLMixer.Check(applied);
+    effective = new AudioThreadPolicy((ThreadSchedule)native.policy, native.priority, (long)native.affinity);
+    return applied!=0;
+  }
+
+  public static AudioLoadStatistics GetLoadStatistics()
+  {
+    AssertInit();
+    GLMixer.LoadStats stats;
+    GLMixer.Check(GLMixer.GetLoadStats(out stats));
+
+    AudioLoadStatistics ret = new AudioLoadStatistics();
+    ret.Buffers              = (int)stats.buffers;
+    ret.Overruns             = (int)stats.overruns;
+    ret.DegradedBuffers      = (int)stats.degraded;
+    ret.VirtualizedVoices    = virtualizedVoices;
+    ret.LastCostMicroseconds = (int)stats.lastCost;
+    ret.PeakCostMicroseconds = (int)stats.peakCost;
+    ret.Load                 = stats.load/1000f;
+    ret.Level                = (AudioLoadLevel)stats.level;
+    return ret;
+  }
+
+  public static void ResetLoadStatistics()
+  {
+    AssertInit();
+    GLMixer.ResetLoadStats();
+    virtualizedVoices = 0;
+  }
+
+  // records the mixer's output to a WAV file. the mixer thread only copies each buffer into a ring, and a background
+  // thread writes it out, so recording doesn't stall the mix; if the disk can't keep up, buffers are dropped and
+  // counted in the recording statistics. the file is 8-bit if the output is, and 16-bit otherwise, unless a format of
+  // U8 or S16 (little-endian) is given. like AllocateChannels, these must not be called while holding the audio lock
+  public static void StartRecording(string path) { StartRecording(path, 0); }
+  public static void StartRecording(string path, SampleFormat format)
+  {
+    AssertInit();
+    if(path==null) throw new ArgumentNullException("path");
+    if(format!=0 && format!=SampleFormat.U8 && format!=SampleFormat.S16)
+      throw new ArgumentException("Recordings must be U8 or S16.", "format");
+    GLMixer.Check(GLMixer.StartRecording(path, (ushort)format));
+  }
+
+  public static void StopRecording()
+  {
+    AssertInit();
+    GLMixer.Check(GLMixer.StopRecording());
+  }
+
+  // publishes the mixer's output, followed by the output of each given bus, in a shared memory object with the given
+  // name (which should start with a slash on POSIX systems), so that other processes can tap the audio without the game
+  // doing any work for them. the layout is described by GLM_ExportHeader in Mixer.h. each ring holds at least
+  // 'bufferMs' milliseconds, and readers that fall further behind lose audio. this must not be called while holding
+  // the audio lock
+  public static void StartExport(string name, int bufferMs, params int[] stemBuses)
+  {
+    AssertInit();
+    if(name==null) throw new ArgumentNullException("name");
+    if(bufferMs<0) throw new ArgumentOutOfRangeException("bufferMs", "cannot be negative");
+    uint[] stems = new uint[stemBuses==null ? 0 : stemBuses.Length];
+    for(int i=0; i<stems.Length; i++)
+    {
+      if(stemBuses[i]<=0) throw new ArgumentOutOfRangeException("stemBuses", "Bus numbers start at 1.");
+      stems[i] = (uint)stemBuses[i];
+    }
+    GLMixer.Check(GLMixer.StartExport(name, (uint)bufferMs, stems, (uint)stems.Length));
+  }
+
+  public static void StopExport()
+  {
+    AssertInit();
+    GLMixer.Check(GLMixer.StopExport());
+  }
+
+  // gets the statistics of the current recording, or the last one if none is in progress
+  public static AudioRecordingStatistics GetRecordingStatistics()
+  {
+    GLMixer.RecordStats stats;
+    GLMixer.Check(GLMixer.GetRecordingStats(out stats));
+
+    AudioRecordingStatistics ret = new AudioRecordingStatistics();
+    ret.FramesWritten = (long)stats.framesWritten;
+    ret.DroppedFrames = (int)stats.framesDropped;
+    ret.Overflows     = (int)stats.overflows;
+    ret.Recording     = stats.recording!=0;
+    ret.Failed        = stats.failed!=0;
+    return ret;
+  }
+
   public static void AllocateChannels(int numChannels) { AllocateChannels(numChannels, true); }
   public static void AllocateChannels(int numChannels, bool resetChannels)
   {
     AssertInit();
     if(numChannels<0) throw new ArgumentOutOfRangeException("numChannels");
+    // the native voices are resized with the audio locked, so that can't be done while holding the callback lock, which
+    // the mixer thread takes inside it
+    int oldChannels = chans.Length;
+    if(numChannels>oldChannels) GLMixer.Check(GLMixer.AllocateVoices((uint)numChannels));
     lock(callback)
     {
       for(int i=numChannels; i<chans.Length; i++)
@@ -1486,59 +2619,149 @@ public static class Audio
         if(resetChannels) chans[i].Reset();
       }
       Channel[] narr = new Channel[numChannels];
-      Array.Copy(chans, narr, chans.Length);
+      Array.Copy(chans, narr, Math.Min(chans.Length, numChannels));
       for(int i=chans.Length; i<numChannels; i++) narr[i] = new Channel(i);
       chans = narr;
       if(numChannels<reserved) reserved=numChannels;
     }
+    if(numChannels<oldChannels) GLMixer.Check(GLMixer.AllocateVoices((uint)numChannels));
+  }
+
+  // allocates submix buses 1 through 'count'. buses are summed into the output after the channels are mixed, and can
+  // be ducked by each other. this must not be called while holding SyncRoot
+  public static void AllocateBuses(int count)
+  {
+    AssertInit();
+    if(count<0) throw new ArgumentOutOfRangeException("count");
+    GLMixer.Check(GLMixer.AllocateBuses((uint)count));
+  }
+
+  public static void SetBusVolume(int bus, int volume)
+  {
+    AssertInit();
+    CheckVolume(volume);
+    GLMixer.Check(GLMixer.SetBusVolume((uint)bus, (ushort)volume));
+  }
+
+  // sets the rate that the bus runs at, or 0 to run it at the output rate. channels playing sounds at the bus's rate are
+  // mixed into it without being resampled, and the bus is resampled to the output rate once. this must not be called
+  // while holding SyncRoot
+  public static void SetBusRate(int bus, int frequency)
+  {
+    AssertInit();
+    if(frequency<0) throw new ArgumentOutOfRangeException("frequency", "cannot be negative");
+    GLMixer.Check(GLMixer.SetBusRate((uint)bus, (uint)frequency));
+  }
+
+  // returns the rate that the bus runs at, or 0 if it runs at the output rate
+  public static int GetBusRate(int bus)
+  {
+    AssertInit();
+    int rate = GLMixer.GetBusRate((uint)bus);
+    GLMixer.Check(rate);
+    return rate;
+  }
+
+  // makes the sidechain bus duck the given bus. when the sidechain's peak level (from 0 to 32767) exceeds the
+  // threshold, the bus's volume falls to 'depth' (0 to MaxVolume) over about attackMs, and recovers over about
+  // releaseMs when the sidechain is quiet again. the ramp is applied per sample by the mixer
+  public static void SetDucking(int bus, int sidechain, int threshold, int depth, int attackMs, int releaseMs)
+  {
+    AssertInit();
+    if(sidechain<=0) throw new ArgumentOutOfRangeException("sidechain");
+    if(threshold<0 || threshold>ushort.MaxValue) throw new ArgumentOutOfRangeException("threshold");
+    CheckVolume(depth);
+    if(attackMs<0) throw new ArgumentOutOfRangeException("attackMs", "cannot be negative");
+    if(releaseMs<0) throw new ArgumentOutOfRangeException("releaseMs", "cannot be negative");
+    GLMixer.Check(GLMixer.SetBusDucking((uint)bus, (uint)sidechain, (ushort)threshold, (ushort)depth, (uint)attackMs,
+                                        (uint)releaseMs));
+  }
+
+  public static void ClearDucking(int bus)
+  {
+    AssertInit();
+    GLMixer.Check(GLMixer.SetBusDucking((uint)bus, 0, 0, MaxVolume, 0, 0));
   }
 
+  // submits an envelope for the bus's volume, as a gain from 0 to 1 on top of the volume set with SetBusVolume, which
+  // the mixer follows from the next buffer on. the last value is held after the envelope ends
+  public static unsafe void AutomateBus(int bus, params Breakpoint[] points)
+  {
+    AssertInit();
+    if(points==null) throw new ArgumentNullException("points");
+    fixed(Breakpoint* p = points) GLMixer.Check(GLMixer.SetBusAutomation((uint)bus, p, (uint)points.Length));
+  }
+
+  // returns the current ducking gain of the bus, from 0 to MaxVolume
+  public static int GetDuckingGain(int bus)
+  {
+    AssertInit();
+    int gain = GLMixer.GetBusGain((uint)bus);
+    GLMixer.Check(gain);
+    return gain;
+  }
+
+  // group membership is kept as a bitmask on each channel, and group commands are queued for the mixer thread, which
+  // applies them at the start of the next buffer. so, group operations never wait for the mixer
   public static int AddGroup()
   {
     AssertInit();
-    lock(groups)
+    while(true)
     {
-      for(int i=0; i<groups.Count; i++)
-        if(groups[i]==null)
-        {
-          groups[i] = new List<int>();
-          return i;
-        }
-      groups.Add(new List<int>());
-      return groups.Count-1;
+      int used = usedGroups, i;
+      for(i=0; i<MaxGroups && (used & (1<<i))!=0; i++) { }
+      if(i==MaxGroups) throw new InvalidOperationException("No more than "+MaxGroups+" groups can exist at once");
+      if(Interlocked.CompareExchange(ref usedGroups, used | (1<<i), used)==used) return ToGroup(i);
     }
   }
 
-  public static void RemoveGroup(int group) { lock(groups) { GetGroup(group); groups[ToGroup(group)]=null; } }
+  public static void RemoveGroup(int group)
+  {
+    int mask = GetGroup(group);
+    for(int i=0; i<chans.Length; i++) UpdateGroups(chans[i], 0, mask);
+    GLMixer.Check(GLMixer.PostGroupCommand((uint)mask, GLMixer.GroupCommand.Volume, MaxVolume));
+    while(true)
+    {
+      int used = usedGroups;
+      if(Interlocked.CompareExchange(ref usedGroups, used & ~mask, used)==used) break;
+    }
+  }
 
   public static void GroupChannel(int channel, int group)
   {
     CheckChannel(channel);
-    lock(groups)
-    {
-      List<int> list = GetGroup(group);
-      if(!list.Contains(channel)) list.Add(channel);
-    }
+    UpdateGroups(chans[channel], GetGroup(group), 0);
   }
 
   public static void GroupRange(int start, int end, int group)
   {
     CheckChannel(start); CheckChannel(end);
     if(start>end) throw new ArgumentException("start should be <= end");
-    lock(groups)
-    {
-      List<int> list = GetGroup(group);
-      for(; start<=end; start++) if(!list.Contains(start)) list.Add(start);
-    }
+    int mask = GetGroup(group);
+    for(; start<=end; start++) UpdateGroups(chans[start], mask, 0);
   }
 
-  public static void UngroupChannel(int channel, int group) { lock(groups) GetGroup(group).Remove(channel); }
+  public static void UngroupChannel(int channel, int group)
+  {
+    CheckChannel(channel);
+    UpdateGroups(chans[channel], 0, GetGroup(group));
+  }
 
-  public static int GroupSize(int group) { lock(groups) return GetGroup(group).Count; }
+  public static int GroupSize(int group)
+  {
+    int mask = GetGroup(group), count = 0;
+    Channel[] chans = Audio.chans;
+    for(int i=0; i<chans.Length; i++) if((chans[i].groups&mask)!=0) count++;
+    return count;
+  }
 
   public static ReadOnlyCollection<int> GetGroupChannels(int group)
   {
-    lock(groups) return GetGroup(group).AsReadOnly();
+    int mask = GetGroup(group);
+    Channel[] chans = Audio.chans;
+    List<int> list = new List<int>();
+    for(int i=0; i<chans.Length; i++) if((chans[i].groups&mask)!=0) list.Add(i);
+    return list.AsReadOnly();
   }
 
   public static int OldestChannel(bool unreserved) { return OldestChannel(-1, unreserved); }
@@ -1553,16 +2776,12 @@ public static class Audio
         for(oi=unreserved ? 0 : reserved, i=oi; i<chans.Length; i++) if(chans[i].Age>age) { age=chans[i].Age; oi=i; }
     }
     else
-      lock(groups)
-      {
-        List<int> list = GetGroup(group);
-        for(oi=i=0; i<list.Count; i++)
-        {
-          int chan = list[i];
-          if(!unreserved && chan<reserved) continue;
-          if(chans[chan].Age>age) { age=chans[chan].Age; oi=chan; }
-        }
-      }
+    {
+      int mask = GetGroup(group);
+      Channel[] chans = Audio.chans;
+      for(oi=0, i=unreserved ? 0 : reserved; i<chans.Length; i++)
+        if((chans[i].groups&mask)!=0 && chans[i].Age>age) { age=chans[i].Age; oi=i; }
+    }
     return oi;
   }
 
@@ -1571,47 +2790,44 @@ public static class Audio
   {
     if(group==-1) lock(callback) for(int i=0; i<chans.Length; i++) chans[i].FadeOut(fadeMs);
     else
-      lock(groups)
-      {
-        List<int> list = GetGroup(group);
-        for(int i=0; i<list.Count; i++) chans[list[i]].FadeOut(fadeMs);
-      }
+    {
+      if(fadeMs<0) throw new ArgumentOutOfRangeException("fadeMs", "cannot be negative");
+      PostGroupCommand(group, GLMixer.GroupCommand.FadeOut, fadeMs);
+    }
   }
 
   public static void Pause() { Pause(-1); }
   public static void Pause(int group)
   {
     if(group==-1) lock(callback) for(int i=0; i<chans.Length; i++) chans[i].Pause();
-    else
-      lock(groups)
-      {
-        List<int> list = GetGroup(group);
-        for(int i=0; i<list.Count; i++) chans[list[i]].Pause();
-      }
+    else PostGroupCommand(group, GLMixer.GroupCommand.Pause, 0);
   }
 
   public static void Resume() { Resume(-1); }
   public static void Resume(int group)
   {
     if(group==-1) lock(callback) for(int i=0; i<chans.Length; i++) chans[i].Resume();
-    else
-      lock(groups)
-      {
-        List<int> list = GetGroup(group);
-        for(int i=0; i<list.Count; i++) chans[list[i]].Resume();
-      }
+    else PostGroupCommand(group, GLMixer.GroupCommand.Resume, 0);
   }
 
   public static void Stop() { Stop(-1); }
   public static void Stop(int group)
   {
     if(group==-1) lock(callback) for(int i=0; i<chans.Length; i++) chans[i].Stop();
-    else
-      lock(groups)
-      {
-        List<int> list = GetGroup(group);
-        for(int i=0; i<list.Count; i++) chans[list[i]].Stop();
-      }
+    else PostGroupCommand(group, GLMixer.GroupCommand.Stop, 0);
+  }
+
+  // restarts the attack of the ADSR envelopes of the channels in the group (or all channels if the group is -1), or
+  // starts their release
+  public static void NoteOn(int group) { PostNoteCommand(group, GLMixer.GroupCommand.NoteOn); }
+  public static void NoteOff(int group) { PostNoteCommand(group, GLMixer.GroupCommand.NoteOff); }
+
+  // sets a volume that applies to every channel in the group, on top of the channels' own volumes. a channel in several
+  // groups gets the product of their volumes
+  public static void SetGroupVolume(int group, int volume)
+  {
+    CheckVolume(volume);
+    PostGroupCommand(group, GLMixer.GroupCommand.Volume, volume);
   }
 
   [CLSCompliant(false)]
@@ -1744,6 +2960,41 @@ public static class Audio
     }
   }
 
+  // mixes 'frames' frames from 'src' into 'dest' through a channel matrix, where matrix[d*srcChannels+s] is the gain
+  // from source channel s to destination channel d. common shapes (eg, 1->2, 2->1, 2->6, 6->2, and 8->2) use
+  // specialized kernels
+  [CLSCompliant(false)]
+  public static unsafe void MatrixMix(int* dest, int destChannels, int* src, int srcChannels, int frames,
+                                      float[] matrix)
+  {
+    if(matrix==null) throw new ArgumentNullException("matrix");
+    if(destChannels<=0 || srcChannels<=0 || frames<0) throw new ArgumentOutOfRangeException();
+    if(matrix.Length<destChannels*srcChannels) throw new ArgumentException("The matrix is too small.", "matrix");
+    fixed(float* m = matrix)
+      GLMixer.Check(GLMixer.MatrixMix(dest, (uint)destChannels, src, (uint)srcChannels, (uint)frames, m));
+  }
+
+  // like MatrixMix, but the gains are in 16.16 fixed point, so 65536 is unity
+  [CLSCompliant(false)]
+  public static unsafe void MatrixMixFixed(int* dest, int destChannels, int* src, int srcChannels, int frames,
+                                           int[] matrix)
+  {
+    if(matrix==null) throw new ArgumentNullException("matrix");
+    if(destChannels<=0 || srcChannels<=0 || frames<0) throw new ArgumentOutOfRangeException();
+    if(matrix.Length<destChannels*srcChannels) throw new ArgumentException("The matrix is too small.", "matrix");
+    fixed(int* m = matrix)
+      GLMixer.Check(GLMixer.MatrixMixFixed(dest, (uint)destChannels, src, (uint)srcChannels, (uint)frames, m));
+  }
+
+  internal static unsafe void MixFilters(FilterCollection filters, Channel channel, int* buffer, int frames,
+                                         AudioFormat format)
+  {
+    if(filters!=null)
+      for(int i=0; i<filters.Count; i++)
+        if(!filters[i].Optional || loadLevel<AudioLoadLevel.NoOptionalEffects)
+          filters[i].MixFilter(channel, buffer, frames, format);
+  }
+
   internal static void OnFiltersFinished(Channel channel)
   {
     if(filters!=null) lock(callback) for(int i=0; i<filters.Count; i++) filters[i].Stop(channel);
@@ -1759,7 +3010,7 @@ public static class Audio
     AssertInit();
     if(reserved==chans.Length) return null;
 
-    IList<int> group = null;
+    int mask = channel==FreeChannel ? 0 : GetGroup(channel);
     bool tried = false;
     do
     {
@@ -1778,23 +3029,17 @@ public static class Audio
           }
       }
       else
-        lock(groups)
+        for(int chan=reserved; chan<chans.Length; chan++)
         {
-          group = GetGroup(channel);
-          for(int i=0; i<group.Count; i++)
+          if((chans[chan].groups&mask)!=0 && chans[chan].Status==ChannelStatus.Stopped) // try to lock as little as possible
           {
-            int chan = group[i];
-            if(chan<reserved) continue;
-            if(chans[chan].Status==ChannelStatus.Stopped) // try to lock as little as possible
-            {
-              tried = true;
-              lock(chans[chan])
-                if(chans[chan].Status==ChannelStatus.Stopped)
-                {
-                  chans[chan].StartPlaying(source, loops, position, fade, fadeMs, timeoutMs);
-                  return chans[chan];
-                }
-            }
+            tried = true;
+            lock(chans[chan])
+              if(chans[chan].Status==ChannelStatus.Stopped)
+              {
+                chans[chan].StartPlaying(source, loops, position, fade, fadeMs, timeoutMs);
+                return chans[chan];
+              }
           }
         }
     } while(!tried);
@@ -1808,13 +3053,8 @@ public static class Audio
           if(channel==FreeChannel)
             for(int i=reserved; i<chans.Length; i++) { if(chans[i].Age>age) { age=chans[i].Age; oi=i; } }
           else
-            lock(groups)
-              for(int i=0; i<group.Count; i++)
-              {
-                int chan = group[i];
-                if(chan<reserved) continue;
-                if(chans[chan].Age>age) { age=chans[chan].Age; oi=chan; }
-              }
+            for(int chan=reserved; chan<chans.Length; chan++)
+              if((chans[chan].groups&mask)!=0 && chans[chan].Age>age) { age=chans[chan].Age; oi=chan; }
           lock(chans[oi]) chans[oi].StartPlaying(source, loops, position, fade, fadeMs, timeoutMs);
           return chans[oi];
         }
@@ -1825,13 +3065,8 @@ public static class Audio
           if(channel==FreeChannel)
             for(int i=reserved; i<chans.Length; i++) { if(chans[i].Priority<prio) { prio=chans[i].Priority; pi=i; } }
           else
-            lock(groups)
-              for(int i=0; i<group.Count; i++)
-              {
-                int chan = group[i];
-                if(chan<reserved) continue;
-                if(chans[chan].Priority<prio) { prio=chans[chan].Priority; pi=chan; }
-              }
+            for(int chan=reserved; chan<chans.Length; chan++)
+              if((chans[chan].groups&mask)!=0 && chans[chan].Priority<prio) { prio=chans[chan].Priority; pi=chan; }
           lock(chans[pi]) chans[pi].StartPlaying(source, loops, position, fade, fadeMs, timeoutMs);
           return chans[pi];
         }
@@ -1847,22 +3082,16 @@ public static class Audio
               if(chans[i].Priority==prio && chans[i].Age>age) { oi=i; age=chans[i].Age; }
           }
           else
-            lock(groups)
-            {
-              for(int i=0; i<group.Count; i++)
-              {
-                int chan = group[i];
-                if(chan<reserved) continue;
-                if(chans[chan].Priority<prio) { prio=chans[chan].Priority; pi=chan; }
-              }
-              oi=pi;
-              for(int i=0; i<group.Count; i++)
+          {
+            for(int chan=reserved; chan<chans.Length; chan++)
+              if((chans[chan].groups&mask)!=0 && chans[chan].Priority<prio) { prio=chans[chan].Priority; pi=chan; }
+            oi=pi;
+            for(int chan=reserved; chan<chans.Length; chan++)
+              if((chans[chan].groups&mask)!=0 && chans[chan].Priority==prio && chans[chan].Age>age)
               {
-                int chan = group[i];
-                if(chan<reserved) continue;
-                if(chans[chan].Priority==prio && chans[chan].Age>age) { oi=chan; age=chans[chan].Age; }
+                oi=chan; age=chans[chan].Age;
               }
-            }
+          }
           lock(chans[oi]) chans[oi].StartPlaying(source, loops, position, fade, fadeMs, timeoutMs);
           return chans[oi];
         }
@@ -1885,14 +3114,36 @@ public static class Audio
   }
 
   static int ToGroup(int group) { return -group-2; }
-  static List<int> GetGroup(int group)
+  // returns the bitmask for the group
+  static int GetGroup(int group)
   {
     AssertInit();
     int index = ToGroup(group);
-    if(index<0 || index>=groups.Count) throw new ArgumentException("Invalid group ID");
-    List<int> list = (List<int>)groups[ToGroup(group)];
-    if(list==null) throw new ArgumentException("Invalid group ID");
-    return list;
+    if(index<0 || index>=MaxGroups || (usedGroups & (1<<index))==0) throw new ArgumentException("Invalid group ID");
+    return 1<<index;
+  }
+
+  static void PostGroupCommand(int group, GLMixer.GroupCommand command, int arg)
+  {
+    GLMixer.Check(GLMixer.PostGroupCommand((uint)GetGroup(group), command, arg));
+  }
+
+  static void PostNoteCommand(int group, GLMixer.GroupCommand command)
+  {
+    AssertInit();
+    GLMixer.Check(GLMixer.PostGroupCommand(group==-1 ? 0 : (uint)GetGroup(group), command, 0));
+  }
+
+  // the mixer applies group changes in the order they're posted, so the change and the post are made under one lock.
+  // otherwise, a thread could post an older value after another thread's newer one
+  static void UpdateGroups(Channel channel, int set, int clear)
+  {
+    lock(groupLock)
+    {
+      int groups = (channel.groups|set) & ~clear;
+      channel.groups = groups;
+      GLMixer.Check(GLMixer.SetVoiceGroups((uint)channel.Number, (uint)groups));
+    }
   }
 
   static void AssertInit()
@@ -1906,9 +3157,29 @@ public static class Audio
     {
       lock(callback)
       {
-        for(int i=0; i<chans.Length; i++) lock(chans[i]) chans[i].Mix(stream, (int)frames, filters);
-        if(postFilters!=null)
-          for(int i=0; i<postFilters.Count; i++) postFilters[i].MixFilter(null, stream, (int)frames, format);
+        loadLevel = (AudioLoadLevel)GLMixer.GetLoadLevel();
+        SelectVirtualChannels();
+        GLMixer.VoiceControl* controls = GLMixer.GetVoiceControls();
+        if(controls!=null) for(int i=0; i<chans.Length; i++) lock(chans[i]) chans[i].ApplyControl(controls+i);
+        FindSharedReads((int)frames);
+        for(int i=0; i<chans.Length; i++)
+          lock(chans[i])
+          {
+            Channel c = chans[i];
+            if(c.sharedDone) continue; // another channel mixed this one's share
+            int* dest = c.Bus==0 ? null : GLMixer.GetBusBuffer((uint)c.Bus);
+            int mixFrames = (int)frames, mixRate = format.Frequency;
+            if(dest!=null) GetBusTiming(c.Bus, ref mixFrames, ref mixRate);
+            if(!c.virtualize || !c.Skip((int)frames))
+            {
+              if(c.sharedLead && c.CanShareRead(mixFrames, mixRate, filters))
+                MixShared(c, dest==null ? stream : dest, mixFrames, mixRate);
+              else c.Mix(dest==null ? stream : dest, mixFrames, mixRate, filters);
+            }
+          }
+        MixBatch(); // the plain sample playback, all in one native call
+        GLMixer.Check(GLMixer.MixBuses(stream, frames)); // so that the post filters see the whole mix
+        MixFilters(postFilters, null, stream, (int)frames, format);
         if(MixPolicy==MixPolicy.Divide) GLMixer.Check(GLMixer.DivideAccumulator(chans.Length));
       }
     }
@@ -1920,16 +3191,179 @@ public static class Audio
     }
   }
 
+  // groups the channels that are playing the same sample from the same position into the same bus, so that the sample
+  // is read and converted once for all of them, with their gains summed. channels drop out of a group as soon as they
+  // stop qualifying (eg, when one is moved, refiltered, or reaches the end of the sample). the locks are released
+  // before the groups are mixed, so MixShared checks the members again
+  static void FindSharedReads(int frames)
+  {
+    if(sharedReaders==null || sharedReaders.Length<chans.Length)
+    {
+      sharedReaders = new int[chans.Length];
+      sharedTails   = new int[chans.Length];
+    }
+    int readers = 0;
+    for(int i=0; i<chans.Length; i++)
+      lock(chans[i])
+      {
+        Channel c = chans[i];
+        c.sharedNext = -1;
+        c.sharedLead = c.sharedDone = false;
+        int mixFrames = frames, mixRate = format.Frequency;
+        if(c.Bus!=0) GetBusTiming(c.Bus, ref mixFrames, ref mixRate);
+        if(!c.CanShareRead(mixFrames, mixRate, filters)) continue;
+
+        int j;
+        for(j=0; j<readers; j++)
+        {
+          Channel r = chans[sharedReaders[j]];
+          if(r.Source==c.Source && r.Position==c.Position && r.Bus==c.Bus) break;
+        }
+        if(j==readers)
+        {
+          sharedReaders[readers] = sharedTails[readers] = i;
+          readers++;
+        }
+        else
+        {
+          chans[sharedReaders[j]].sharedLead = true;
+          chans[sharedTails[j]].sharedNext   = i;
+          sharedTails[j] = i;
+        }
+      }
+  }
+
+  // mixes a group found by FindSharedReads with a single read, called with the leader locked. each member is locked
+  // and checked again, since the game may have moved or stopped it after the group was found. members that no longer
+  // match are left to be mixed on their own
+  static unsafe void MixShared(Channel leader, int* stream, int frames, int rate)
+  {
+    int left=leader.EffectiveLeft, right=leader.EffectiveRight;
+    for(int i=leader.sharedNext; i>=0; i=chans[i].sharedNext)
+    {
+      Channel c = chans[i];
+      lock(c)
+      {
+        if(c.Source==leader.Source && c.Position==leader.Position && c.Bus==leader.Bus &&
+           c.CanShareRead(frames, rate, filters))
+        {
+          left  += c.EffectiveLeft;
+          right += c.EffectiveRight;
+          c.SkipShared(frames);
+          c.sharedDone = true;
+        }
+      }
+    }
+    leader.QueueShared(stream, frames, left, right);
+  }
+
+  // adds a run of a sample to the batch mixed by MixBatch. the sample's data is pinned until then
+  internal static unsafe void QueueVoice(SampleSource sample, int position, int* dest, int frames, int left, int right)
+  {
+    if(batch==null || batchCount==batch.Length)
+    {
+      int size = batch==null ? 32 : batch.Length*2;
+      GLMixer.VoiceMix[] newBatch = new GLMixer.VoiceMix[size];
+      GCHandle[] newPins = new GCHandle[size*2];
+      if(batch!=null)
+      {
+        Array.Copy(batch, newBatch, batchCount);
+        Array.Copy(batchPins, newPins, batchCount*2);
+      }
+      batch     = newBatch;
+      batchPins = newPins;
+    }
+
+    GLMixer.VoiceMix voice = new GLMixer.VoiceMix();
+    batchPins[batchCount*2] = GCHandle.Alloc(sample.Data, GCHandleType.Pinned);
+    voice.data = (byte*)batchPins[batchCount*2].AddrOfPinnedObject().ToPointer();
+    if(sample.Silence!=null)
+    {
+      batchPins[batchCount*2+1] = GCHandle.Alloc(sample.Silence, GCHandleType.Pinned);
+      voice.silence = (byte*)batchPins[batchCount*2+1].AddrOfPinnedObject().ToPointer();
+    }
+    voice.dest      = dest;
+    voice.position  = (uint)position;
+    voice.frames    = (uint)frames;
+    voice.format    = (ushort)sample.Format.Format;
+    voice.channels  = sample.Format.Channels;
+    voice.left      = voice.leftTarget  = (uint)left;
+    voice.right     = voice.rightTarget = (uint)right;
+    batch[batchCount++] = voice;
+  }
+
+  // mixes the voices queued by QueueVoice with a single native call, and unpins their data
+  static unsafe void MixBatch()
+  {
+    if(batchCount==0) return;
+    try
+    {
+      fixed(GLMixer.VoiceMix* voices = batch) GLMixer.Check(GLMixer.MixBatch(voices, (uint)batchCount));
+    }
+    finally
+    {
+      for(int i=0; i<batchCount*2; i++) if(batchPins[i].IsAllocated) batchPins[i].Free();
+      batchCount = 0;
+    }
+  }
+
+  // gets the number of frames to mix into a bus in this buffer, and the rate it runs at, if the bus has its own rate
+  static void GetBusTiming(int bus, ref int frames, ref int rate)
+  {
+    int busRate = GLMixer.GetBusRate((uint)bus);
+    if(busRate>0)
+    {
+      rate   = busRate;
+      frames = GLMixer.GetBusFrames((uint)bus);
+    }
+  }
+
+  // when the mixer is overloaded, marks the lowest-priority (and then oldest) playing channels to be skipped
+  static void SelectVirtualChannels()
+  {
+    int playing = 0, count;
+    for(int i=0; i<chans.Length; i++)
+    {
+      chans[i].virtualize = false;
+      if(chans[i].Status==ChannelStatus.Playing) playing++;
+    }
+
+    count = loadLevel==AudioLoadLevel.Critical ? playing/2 : loadLevel==AudioLoadLevel.FewerVoices ? playing/4 : 0;
+    virtualizedVoices += count;
+    for(; count>0; count--)
+    {
+      Channel victim = null;
+      for(int i=0; i<chans.Length; i++)
+      {
+        Channel c = chans[i];
+        if(c.virtualize || c.Status!=ChannelStatus.Playing) continue;
+        if(victim==null || c.Priority<victim.Priority || c.Priority==victim.Priority && c.Age>victim.Age) victim=c;
+      }
+      victim.virtualize = true;
+    }
+  }
+
   static AudioFormat format;
+  static AudioOutput output;
   static FilterCollection filters, postFilters;
   static GLMixer.MixCallback callback;
   static Channel[] chans = new Channel[0];
-  static List<List<int>> groups;
+  static int usedGroups;
+  static readonly object groupLock = new object(); // serializes changes to the channels' groups
+  const int MaxGroups = 32;
   static int reserved;
   static PlayPolicy playPolicy = PlayPolicy.Fail;
   static MixPolicy mixPolicy  = MixPolicy.DontDivide;
-  static bool init;
+  static AudioLoadLevel loadLevel;
+  static int virtualizedVoices;
+  static int[] sharedReaders, sharedTails; // the first and last channels of the groups found by FindSharedReads
+  static GLMixer.VoiceMix[] batch; // the voices queued for MixBatch
+  static GCHandle[] batchPins;  // the pinned data of the queued voices, two handles per voice
+  static int batchCount;
+  static bool init, decodeCache;
+  static readonly Queue<ThreadStart> workQueue = new Queue<ThreadStart>();
+  static Thread worker;
 }
 #endregion
 
-} // namespace GameLib.Audio
\ No newline at end of file
+} // namespace GameLib.Audio
\ No newline at end of file
@@ -18,6 +18,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 using System;
 using System.Runtime.InteropServices;
+using System.Text;
+using GameLib.Audio;
 
 namespace GameLib.Interop.GLMixer
 {
@@ -29,6 +31,78 @@ public static class GLMixer
   [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
   internal unsafe delegate void MixCallback(int* stream, uint samples, IntPtr context);
 
+  internal const int SilenceBlock = 256; // the number of frames covered by each bit of a silence map
+
+  internal enum Backend { Sdl, Null, WaveFile }
+  internal enum Quality { Low, Normal, High }
+
+  [StructLayout(LayoutKind.Sequential, Pack=4)]
+  internal struct LoadStats
+  {
+    public uint buffers, overruns, degraded, lastCost, peakCost;
+    public ushort load, level;
+  }
+
+  [StructLayout(LayoutKind.Sequential)]
+  internal unsafe struct VoiceMix
+  {
+    public byte* data;
+    public int* dest;
+    public byte* silence;
+    public uint position, frames;
+    public ushort format;
+    public byte channels, reserved;
+    public uint left, right, leftTarget, rightTarget;
+  }
+
+  [StructLayout(LayoutKind.Sequential)]
+  internal struct RecordStats
+  {
+    public ulong framesWritten;
+    public uint framesDropped, overflows;
+    public int recording, failed;
+  }
+
+  [StructLayout(LayoutKind.Sequential)]
+  internal struct ThreadPolicy
+  {
+    public int policy, priority;
+    public ulong affinity;
+  }
+
+  [StructLayout(LayoutKind.Sequential)]
+  internal unsafe struct MapInfo
+  {
+    public byte* data;
+    public uint bytes, freq;
+    public ushort format;
+    public byte channels;
+  }
+
+  [StructLayout(LayoutKind.Sequential)]
+  internal unsafe struct LoudnessJob
+  {
+    public void* data;
+    public uint frames, freq;
+    public ushort format;
+    public byte channels;
+    public float loudness, truePeak, gain;
+  }
+
+  internal enum GroupCommand { Pause, Resume, Stop, FadeOut, Volume, NoteOn, NoteOff }
+
+  [StructLayout(LayoutKind.Sequential, Pack=4)]
+  internal struct VoiceControl
+  {
+    public const ushort Pause=1, Resume=2, Stop=4, FadeOut=8;
+    public const uint AdsrActive = 0x100;
+    public const uint GainAutomation = (1<<(int)AutomationParameter.Volume) | (1<<(int)AutomationParameter.Pan) | AdsrActive;
+    public ushort flags, volume;
+    public uint fadeMs;
+    public float rate;
+    public uint automation;
+  }
+
   [Flags]
   internal enum Format : short
   { Eight=8, Sixteen=16, BitsPart=0xFF, BigEndian=0x1000, FloatingPoint=0x4000, Signed=unchecked((short)0x8000),
@@ -57,16 +131,95 @@ public static class GLMixer
 
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_Init", CallingConvention=CallingConvention.Cdecl)]
   internal static extern int Init(uint freq, ushort format, byte channels, uint bufferMs, MixCallback callback, IntPtr context);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_InitEx", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int Init(uint freq, ushort format, byte channels, uint bufferMs, MixCallback callback, IntPtr context,
+                                  Backend backend, [MarshalAs(UnmanagedType.LPStr)] string arg);
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetFormat", CallingConvention=CallingConvention.Cdecl)]
   internal static extern int GetFormat(out uint freq, out ushort format, out byte channels, out uint bufferBytes);
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_Quit", CallingConvention=CallingConvention.Cdecl)]
   internal static extern void Quit();
 
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_PauseAudio", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern void PauseAudio(int pause);
+
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetMixVolume", CallingConvention=CallingConvention.Cdecl)]
   internal static extern ushort GetMixVolume();
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetMixVolume", CallingConvention=CallingConvention.Cdecl)]
   internal static extern void SetMixVolume(ushort volume);
 
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetLoadBudget", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern ushort GetLoadBudget();
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetLoadBudget", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern void SetLoadBudget(ushort permille);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetLoadLevel", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int GetLoadLevel();
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetLoadStats", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int GetLoadStats(out LoadStats stats);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_ResetLoadStats", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern void ResetLoadStats();
+
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetThreadPolicy", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SetThreadPolicy(int thread, ref ThreadPolicy policy);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetThreadPolicy", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int GetThreadPolicy(int thread, out ThreadPolicy requested, out ThreadPolicy effective);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_UpdateThreadPolicy", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int UpdateThreadPolicy(int thread, ref uint applied);
+
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_AllocateVoices", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int AllocateVoices(uint count);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_ResetVoice", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int ResetVoice(uint voice);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetVoiceFilter", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SetVoiceFilter(uint handle, uint lowPass, uint highPass);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_FilterVoice", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int FilterVoice(uint voice, int* buffer, uint frames);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetVoiceGroups", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SetVoiceGroups(uint voice, uint groups);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_PostGroupCommand", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int PostGroupCommand(uint groups, GroupCommand command, int arg);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetVoiceControls", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern VoiceControl* GetVoiceControls();
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_AcquireVoice", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern uint AcquireVoice(uint voice);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_ReleaseVoice", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int ReleaseVoice(uint voice);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_VoiceFromHandle", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int VoiceFromHandle(uint handle);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_PostVoiceCommand", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int PostVoiceCommand(uint handle, GroupCommand command, int arg);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetVoiceAutomation", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int SetVoiceAutomation(uint handle, AutomationParameter param, Breakpoint* points, uint count);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetVoiceAdsr", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int SetVoiceAdsr(uint handle, AdsrEnvelope* adsr);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_AutomateVoice", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int AutomateVoice(uint voice, int* buffer, uint offset, uint frames);
+
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_AllocateBuses", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int AllocateBuses(uint count);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetBusBuffer", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int* GetBusBuffer(uint bus);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetBusFrames", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int GetBusFrames(uint bus);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetBusRate", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SetBusRate(uint bus, uint freq);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetBusRate", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int GetBusRate(uint bus);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetBusVolume", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SetBusVolume(uint bus, ushort volume);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetBusDucking", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SetBusDucking(uint bus, uint sidechain, ushort threshold, ushort depth, uint attackMs, uint releaseMs);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetBusGain", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int GetBusGain(uint bus);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetBusAutomation", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int SetBusAutomation(uint bus, Breakpoint* points, uint count);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_MixBuses", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int MixBuses(int* dest, uint frames);
+
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetLodThresholds", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern void SetLodThresholds(ushort reduced, ushort low, ushort minimal, int priorityWeight);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SelectLod", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SelectLod(ushort leftVolume, ushort rightVolume, int priority);
+
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_ConvertAcc", CallingConvention=CallingConvention.Cdecl)]
   public unsafe static extern int ConvertAccumulator(void* dest, int* src, uint samples, ushort destFormat);
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetupCVT", CallingConvention=CallingConvention.Cdecl)]
@@ -74,18 +227,98 @@ public static class GLMixer
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_Convert", CallingConvention=CallingConvention.Cdecl)]
   public static extern int Convert(ref AudioConversion cvt);
 
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_CreateStreamConverter", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern IntPtr CreateStreamConverter(int srcRate, ushort srcFormat, byte srcChans,
+                                                      int destRate, ushort destFormat, byte destChans);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_FreeStreamConverter", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern void FreeStreamConverter(IntPtr cvt);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetStreamRate", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SetStreamRate(IntPtr cvt, int srcRate);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetStreamQuality", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SetStreamQuality(IntPtr cvt, Quality quality);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_ResetStream", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int ResetStream(IntPtr cvt);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_StreamInputSize", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int StreamInputSize(IntPtr cvt, uint destFrames);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_StreamOutputSize", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int StreamOutputSize(IntPtr cvt, uint srcBytes);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_StreamConvert", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int StreamConvert(IntPtr cvt, void* src, uint srcBytes, void* dest, uint destBytes);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_StreamFlush", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int StreamFlush(IntPtr cvt, void* dest, uint destBytes);
+
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_MapWave", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern IntPtr MapWave(string path, out MapInfo info);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_MapRaw", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern IntPtr MapRaw(string path, uint offset, uint length, ref MapInfo info);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_UnmapFile", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern void UnmapFile(IntPtr file);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_AdviseMapping", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int AdviseMapping(IntPtr file, byte* data, uint bytes);
+
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_CreateNoise", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern IntPtr CreateNoise(NoiseType type, uint seed);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_FreeNoise", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern void FreeNoise(IntPtr noise);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetNoiseFilter", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SetNoiseFilter(IntPtr noise, uint lowPass, uint highPass);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_MixNoise", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int MixNoise(IntPtr noise, int* dest, uint frames, ushort leftVolume, ushort rightVolume);
+
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_AnalyzeLoudness", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int AnalyzeLoudness(LoudnessJob* jobs, uint count, float target, float ceiling,
+                                                    uint threads);
+
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_StartRecording", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int StartRecording(string path, ushort format);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_StopRecording", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int StopRecording();
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_GetRecordingStats", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int GetRecordingStats(out RecordStats stats);
+
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_StartExport", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int StartExport(string name, uint bufferMs, uint[] stems, uint stemCount);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_StopExport", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int StopExport();
+
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_SetCacheDirectory", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int SetCacheDirectory(string directory, ulong maxBytes);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_HashFile", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int HashFile(string path, out ulong hash);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_CacheLookup", CallingConvention=CallingConvention.Cdecl)]
+  internal static extern int CacheLookup(ulong hash, uint freq, ushort format, byte channels, StringBuilder path,
+                                         uint pathSize);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_CacheStore", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int CacheStore(ulong hash, uint freq, ushort format, byte channels, void* data,
+                                               uint bytes);
+
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_Copy", CallingConvention=CallingConvention.Cdecl)]
   public unsafe static extern int Copy(int* dest, int* src, uint samples);
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_VolumeScale", CallingConvention=CallingConvention.Cdecl)]
   public unsafe static extern int VolumeScale(int* stream, uint samples, ushort leftVolume, ushort rightVolume);
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_Mix", CallingConvention=CallingConvention.Cdecl)]
   internal unsafe static extern int Mix(int* dest, int* src, uint samples, ushort leftVolume, ushort rightVolume);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_MixGain", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int MixGain(int* dest, int* src, uint samples, uint leftGain, uint rightGain);
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_ConvertMix", CallingConvention=CallingConvention.Cdecl)]
   internal unsafe static extern int ConvertMix(int* dest, void* src, uint samples, ushort channels, ushort srcFormat, ushort leftVolume, ushort rightVolume);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_MatrixMix", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int MatrixMix(int* dest, uint destChans, int* src, uint srcChans, uint frames,
+                                              float* matrix);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_MatrixMixFixed", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int MatrixMixFixed(int* dest, uint destChans, int* src, uint srcChans, uint frames,
+                                                   int* matrix);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_MixBatch", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int MixBatch(VoiceMix* voices, uint count);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_ConvertMixMono", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int ConvertMixMono(int* dest, void* src, uint frames, ushort srcFormat, ushort leftVolume, ushort rightVolume);
   [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_DivideAccumulator", CallingConvention=CallingConvention.Cdecl)]
   internal static extern int DivideAccumulator(int divisor);
+  [DllImport(Config.GLMixerImportPath, ExactSpelling=true, EntryPoint="GLM_BuildSilenceMap", CallingConvention=CallingConvention.Cdecl)]
+  internal unsafe static extern int BuildSilenceMap(void* data, uint frames, ushort format, byte channels,
+                                                    ushort threshold, byte* map);
 
   public static void Check(int result) { if(result<0) SDL.SDL.RaiseError(); } // TODO: do something more appropriate
 }
 
-} // namespace GameLib.Interop.GLMixer
\ No newline at end of file
+} // namespace GameLib.Interop.GLMixer
\ No newline at end of file
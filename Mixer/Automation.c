@@ -0,0 +1,106 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* breakpoint envelopes for parameter automation. the game submits an envelope once, and the mixer follows it from then
+   on. envelopes are written by the game thread into a pending copy guarded by a sequence counter, and the mixer takes
+   the pending copy at the start of a buffer if it wasn't being written at the time, so neither side ever waits.
+*/
+
+#include "Internal.h"
+#include <math.h>
+#include <string.h>
+
+/* sets the envelope's pending points, which the mixer will start following at its next buffer. the values must be
+   within [min, max]. only one thread may write to a given envelope at a time
+*/
+int GLM_setEnvelope(GLM_Envelope *env, const GLM_Breakpoint *points, Uint32 count, Uint32 freq, float min, float max)
+{ Uint32 i;
+
+  if(count && !points)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(count>GLM_MAX_BREAKPOINTS)
+  { SDL_SetError("Too many breakpoints");
+    return -1;
+  }
+  for(i=0; i<count; i++)
+  { if(points[i].curve<GLM_CURVE_LINEAR || points[i].curve>GLM_CURVE_EXP)
+    { SDL_SetError("Invalid curve");
+      return -1;
+    }
+    if(!(points[i].value>=min && points[i].value<=max) || (i && points[i].time<points[i-1].time) ||
+       (points[i].curve==GLM_CURVE_EXP && (points[i].value<=0 || (i && points[i-1].value<=0))))
+    { SDL_SetError("Invalid breakpoint");
+      return -1;
+    }
+  }
+
+  env->seq++; /* odd while writing */
+  GLM_BARRIER();
+  for(i=0; i<count; i++)
+  { env->pending.frames[i] = (Uint32)((Uint64)points[i].time*freq/1000);
+    env->pending.values[i] = points[i].value;
+    env->pending.curves[i] = (Uint8)points[i].curve;
+  }
+  env->pending.count = count;
+  GLM_BARRIER();
+  env->seq++;
+  return 0;
+}
+
+/* called by the mixer at the start of each buffer to pick up new points and move the envelope forward by a buffer.
+   returns whether the envelope is active. GLM_evalEnvelope is relative to the start of the buffer
+*/
+int GLM_advanceEnvelope(GLM_Envelope *env, Uint32 frames)
+{ const GLM_Points *p = &env->active;
+  Uint32 seq = env->seq, last;
+
+  if(seq!=env->taken && !(seq&1))
+  { GLM_Points points;
+    GLM_BARRIER();
+    memcpy(&points, &env->pending, sizeof(points));
+    GLM_BARRIER();
+    if(env->seq==seq) /* otherwise, it was rewritten while we copied it, so try again next buffer */
+    { env->active = points;
+      env->taken  = seq;
+      env->pos = env->segment = 0;
+    }
+  }
+  if(!p->count) return 0;
+
+  env->start = env->pos;
+  while(env->segment<p->count && p->frames[env->segment]<=env->start) env->segment++;
+  last = p->frames[p->count-1];
+  if(env->pos<=last) env->pos += frames; /* stop counting once the end is passed, since the last value is held */
+  return 1;
+}
+
+/* returns the envelope's value 'offset' frames into the current buffer */
+float GLM_evalEnvelope(const GLM_Envelope *env, Uint32 offset)
+{ const GLM_Points *p = &env->active;
+  Uint32 pos = env->start+offset, i = env->segment;
+  float  a, b, t;
+
+  while(i<p->count && p->frames[i]<=pos) i++;
+  if(!i) return p->values[0];
+  if(i==p->count) return p->values[i-1];
+
+  a = p->values[i-1], b = p->values[i];
+  t = (float)(pos-p->frames[i-1]) / (float)(p->frames[i]-p->frames[i-1]);
+  return p->curves[i]==GLM_CURVE_EXP ? a*(float)pow(b/a, t) : a+(b-a)*t;
+}
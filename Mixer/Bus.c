@@ -0,0 +1,316 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* submix buses. voices can be mixed into a bus instead of the main accumulator, and the buses are then summed into the
+   accumulator with their own volumes. a bus can be ducked by another one (its sidechain), so that eg, music gets
+   quieter while dialogue is playing. bus 0 is the main accumulator itself. a bus's volume can also be automated with
+   an envelope, which is evaluated at the end of each buffer and ramped towards.
+
+   a bus can also run at a lower rate than the output (eg, for ambience recorded at 22kHz). voices playing at the bus's
+   rate are then mixed into it without being resampled, and the bus is resampled to the output rate once, with cubic
+   interpolation, before it's mixed. the number of frames to mix into such a bus varies from buffer to buffer, and is
+   given by GLM_GetBusFrames.
+*/
+
+#include "Internal.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GAIN_ONE 65536
+#define HISTORY  4 /* the number of input frames kept between buffers for the resampler */
+
+typedef struct
+{ Sint32 *buffer;
+  Sint32 volume, curVolume;  /* the requested volume and the volume reached at the end of the last buffer (0-256) */
+  Uint32 sidechain;          /* the bus that ducks this one, or 0 if ducking is disabled */
+  Sint32 threshold, depth;   /* the sidechain peak that triggers ducking, and the gain when ducked in 16.16 */
+  Sint32 attack, release;    /* one-pole coefficients for the gain envelope, in 16.16 */
+  Sint32 gain, detector;     /* the current ducking gain in 16.16, and the sidechain's peak envelope */
+  GLM_Envelope automation;   /* a gain applied on top of the volume */
+  Sint32 *input;             /* for a resampled bus, HISTORY frames of history followed by the buffer at the bus rate */
+  Uint32 rate, step, pos;    /* the bus rate, the input frames per output frame, and the input position, in 16.16 */
+  Uint32 inputFrames;        /* the number of frames to be mixed into the input this buffer */
+} Bus;
+
+static Bus    *buses;        /* buses[0] is unused, so that the array can be indexed by bus number */
+static Uint32 busCount, busSamples, busFreq, busMixed, busFrames;
+static Uint16 busFormat;
+static Uint8  busChans;
+
+/* returns a one-pole smoothing coefficient that covers most of the distance in the given time */
+static Sint32 TimeToCoef(Uint32 ms)
+{ double samples = (double)ms*busFreq/1000;
+  return samples<1 ? GAIN_ONE : (Sint32)((1-exp(-1/samples)) * GAIN_ONE + 0.5);
+}
+
+static Bus* GetBus(Uint32 bus)
+{ if(!bus || bus>busCount)
+  { SDL_SetError("Invalid bus");
+    return NULL;
+  }
+  return buses+bus;
+}
+
+/* allocates buses 1 through 'count'. existing buses keep their settings */
+int GLM_AllocateBuses(Uint32 count)
+{ Uint32 bytes, i;
+  Bus    *nb=NULL;
+
+  if(GLM_GetFormat(&busFreq, &busFormat, &busChans, &bytes)<0) return -1;
+  busSamples = bytes/BYTES(busFormat);
+
+  if(count)
+  { nb = (Bus*)calloc(count+1, sizeof(Bus));
+    if(!nb) goto nomem;
+    for(i=busCount+1; i<=count; i++)
+    { nb[i].buffer = (Sint32*)malloc(busSamples*sizeof(Sint32));
+      if(!nb[i].buffer) goto nomem;
+      nb[i].volume = nb[i].curVolume = 256;
+      nb[i].gain   = nb[i].depth = GAIN_ONE;
+    }
+  }
+
+  GLM_LockAudio(); /* the existing buses are copied with the audio locked, since the mixer updates them */
+  for(i=1; i<=count; i++)
+  { if(i<=busCount) nb[i] = buses[i];
+    if(nb[i].sidechain>count) nb[i].sidechain=0;
+  }
+  for(i=count+1; i<=busCount; i++) free(buses[i].buffer), free(buses[i].input);
+  free(buses);
+  buses=nb, busCount=count;
+  GLM_UnlockAudio();
+  return 0;
+
+  nomem:
+  if(nb)
+  { for(i=1; i<=count; i++) if(i>busCount) free(nb[i].buffer);
+    free(nb);
+  }
+  SDL_SetError("Out of memory");
+  return -1;
+}
+
+/* returns the buffer that voices should be mixed into to play through the given bus, valid until the end of the
+   current callback
+*/
+Sint32* GLM_GetBusBuffer(Uint32 bus)
+{ Bus *b = GetBus(bus);
+  return !b ? NULL : b->input ? b->input+HISTORY*busChans : b->buffer;
+}
+
+/* returns the bus's output for the current callback, at the mixer's rate, or NULL if the buses haven't been mixed */
+Sint32* GLM_getBusOutput(Uint32 bus)
+{ return bus && bus<=busCount && busMixed ? buses[bus].buffer : NULL; /* no error, since it's called by the mixer */
+}
+
+/* returns the number of frames that should be mixed into the bus's buffer in the current callback. this is the number
+   of frames in the output buffer unless the bus runs at a different rate
+*/
+int GLM_GetBusFrames(Uint32 bus)
+{ Bus *b = GetBus(bus);
+  return !b ? -1 : b->input ? (int)b->inputFrames : (int)busFrames;
+}
+
+/* sets the rate that the bus runs at, in Hz, or 0 to run at the output rate */
+int GLM_SetBusRate(Uint32 bus, Uint32 freq)
+{ Bus    *b = GetBus(bus);
+  Sint32 *input=NULL, *old;
+  Uint32 step=0;
+
+  if(!b) return -1;
+  if(freq==busFreq) freq=0;
+  if(freq)
+  { Uint32 maxFrames;
+    if(freq<1000 || freq>busFreq*4)
+    { SDL_SetError("Invalid bus rate");
+      return -1;
+    }
+    step      = (Uint32)(((Uint64)freq<<16) / busFreq);
+    maxFrames = (Uint32)(((Uint64)busSamples/busChans*step + 65535) >> 16) + 1;
+    input     = (Sint32*)calloc((maxFrames+HISTORY)*busChans, sizeof(Sint32));
+    if(!input)
+    { SDL_SetError("Out of memory");
+      return -1;
+    }
+  }
+
+  GLM_LockAudio();
+  old = b->input;
+  b->input = input, b->rate = freq, b->step = step, b->pos = 0, b->inputFrames = 0;
+  GLM_UnlockAudio();
+  free(old);
+  return 0;
+}
+
+/* returns the bus's rate, or 0 if it runs at the output rate */
+int GLM_GetBusRate(Uint32 bus)
+{ Bus *b = GetBus(bus);
+  return b ? (int)b->rate : -1;
+}
+
+int GLM_SetBusVolume(Uint32 bus, Uint16 volume)
+{ Bus *b = GetBus(bus);
+  if(!b) return -1;
+  if(volume>256)
+  { SDL_SetError("Invalid bus volume");
+    return -1;
+  }
+  b->volume = volume;
+  return 0;
+}
+
+/* makes 'sidechain' duck 'bus'. when the sidechain's peak level (on a 16-bit scale) exceeds 'threshold', the bus's
+   gain falls to 'depth' (0-256) over about 'attackMs', and it recovers over about 'releaseMs' once the sidechain is
+   quiet again. a sidechain of 0 disables ducking.
+*/
+int GLM_SetBusDucking(Uint32 bus, Uint32 sidechain, Uint16 threshold, Uint16 depth, Uint32 attackMs, Uint32 releaseMs)
+{ Bus *b = GetBus(bus);
+  if(!b) return -1;
+  if(sidechain==bus || sidechain>busCount)
+  { SDL_SetError("Invalid sidechain bus");
+    return -1;
+  }
+  if(depth>256)
+  { SDL_SetError("Invalid ducking depth");
+    return -1;
+  }
+  b->threshold = BITS(busFormat)==8 ? threshold>>8 : threshold;
+  b->depth     = depth<<8;
+  b->attack    = TimeToCoef(attackMs);
+  b->release   = TimeToCoef(releaseMs);
+  b->sidechain = sidechain;
+  return 0;
+}
+
+/* sets an envelope for the bus's volume, as a gain from 0 to 1 applied on top of the volume set with GLM_SetBusVolume.
+   the last value is held after the envelope ends. a count of zero removes the automation
+*/
+int GLM_SetBusAutomation(Uint32 bus, const GLM_Breakpoint *points, Uint32 count)
+{ Bus *b = GetBus(bus);
+  return b ? GLM_setEnvelope(&b->automation, points, count, busFreq, 0, 1) : -1;
+}
+
+/* returns the bus's current ducking gain, from 0-256 */
+int GLM_GetBusGain(Uint32 bus)
+{ Bus *b = GetBus(bus);
+  return b ? b->gain>>8 : -1;
+}
+
+/* resamples the bus's input to the output rate, into its buffer, with Catmull-Rom interpolation. the input position
+   starts within the frame after the history, and the last HISTORY input frames are kept for the next buffer
+*/
+static void ResampleBus(Bus *b, Uint32 frames)
+{ const Sint32 *in = b->input;
+  Sint32 *out = b->buffer;
+  Uint32 pos = b->pos, i, c, n = b->inputFrames;
+
+  for(i=0; i<frames; pos+=b->step,i++)
+  { const Sint32 *x = in + (pos>>16)*busChans;
+    float t = (pos&0xFFFF) * (1.0f/65536);
+    for(c=0; c<busChans; x++,c++)
+    { float x0=(float)x[0], x1=(float)x[busChans], x2=(float)x[busChans*2], x3=(float)x[busChans*3];
+      *out++ = (Sint32)(x1 + 0.5f*t*((x2-x0) + t*((2*x0-5*x1+4*x2-x3) + t*(3*(x1-x2)+x3-x0))));
+    }
+  }
+  memmove(b->input, b->input+n*busChans, HISTORY*busChans*sizeof(Sint32));
+  b->pos = pos - (n<<16);
+}
+
+static void MixBus(Sint32 *dest, Bus *b, Uint32 frames)
+{ const Sint32 *src = b->buffer, *sc = b->sidechain ? buses[b->sidechain].buffer : NULL;
+  Sint32 volume = b->volume, vol, vstep;
+  Sint32 gain = b->gain, det = b->detector, target, peak, v, decay = busFreq/100; /* the detector falls over ~10ms */
+  Uint32 i, c;
+
+  if(GLM_advanceEnvelope(&b->automation, frames))
+    volume = (Sint32)(volume*GLM_evalEnvelope(&b->automation, frames) + 0.5f);
+  vol = b->curVolume<<16, vstep = (volume-b->curVolume)*65536/(Sint32)frames;
+
+  if(!sc && gain==GAIN_ONE && !vstep)
+  { if(vol==256<<16) for(i=0; i<frames*busChans; i++) dest[i] += src[i];
+    else for(i=0, v=vol>>16; i<frames*busChans; i++) dest[i] += (src[i]*v)>>8;
+  }
+  else
+    for(i=0; i<frames; vol+=vstep,src+=busChans,dest+=busChans,i++)
+    { if(sc) /* follow the sidechain's peak level, and move the gain towards the ducked or normal level */
+      { for(c=0,peak=0; c<busChans; c++)
+        { v = *sc++;
+          if(v<0) v=-v;
+          if(v>peak) peak=v;
+        }
+        if(peak>det) det=peak;
+        else det -= det/decay + 1;
+        if(det<0) det=0;
+        target = det>b->threshold ? b->depth : GAIN_ONE;
+      }
+      else target = GAIN_ONE;
+      gain += (Sint32)(((Sint64)(target-gain) * (target<gain ? b->attack : b->release))>>16);
+
+      v = (Sint32)(((Sint64)gain*(vol>>8))>>16); /* combined gain, 16.16 */
+      for(c=0; c<busChans; c++) dest[c] += (Sint32)(((Sint64)src[c]*v)>>16);
+    }
+
+  b->gain=gain, b->detector=det, b->curVolume=volume;
+}
+
+/* sums the buses into 'dest'. this is done automatically after the mix callback, but a callback that processes the
+   final mix (eg, with post filters) can call it itself first
+*/
+int GLM_MixBuses(Sint32 *dest, Uint32 frames)
+{ Uint32 i;
+  if(!dest)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(frames*busChans>busSamples)
+  { SDL_SetError("Too many frames");
+    return -1;
+  }
+  if(!busMixed)
+  { for(i=1; i<=busCount; i++) if(buses[i].input) ResampleBus(buses+i, frames); /* first, since they may be sidechains */
+    for(i=1; i<=busCount; i++) MixBus(dest, buses+i, frames);
+    busMixed = 1;
+  }
+  return 0;
+}
+
+void GLM_clearBuses(Uint32 samples)
+{ Uint32 i;
+  if(!busCount) return; /* busChans isn't known until buses are allocated */
+  busFrames = samples/busChans;
+  for(i=1; i<=busCount; i++)
+  { Bus *b = buses+i;
+    if(!b->input) memset(b->buffer, 0, samples*sizeof(Sint32));
+    else /* the input frames needed to produce the output, leaving the position within the first frame after them */
+    { b->inputFrames = (Uint32)(((Uint64)b->pos + (Uint64)busFrames*b->step) >> 16);
+      memset(b->input+HISTORY*busChans, 0, b->inputFrames*busChans*sizeof(Sint32));
+    }
+  }
+  busMixed = 0;
+}
+
+void GLM_finishBuses(Sint32 *dest, Uint32 frames)
+{ if(busCount) GLM_MixBuses(dest, frames);
+}
+
+void GLM_freeBuses()
+{ Uint32 i;
+  for(i=1; i<=busCount; i++) free(buses[i].buffer), free(buses[i].input);
+  free(buses);
+  buses=NULL, busCount=0;
+}
@@ -0,0 +1,275 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* an on-disk cache of decoded audio. entries are WAV files named after a hash of the source file's contents and the
+   format they were decoded to, so they can be memory-mapped with GLM_MapWave, and a changed source simply gets a new
+   entry. the least recently used entries are deleted when the cache grows past its size limit.
+*/
+
+#include "Internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#define MAX_PATH_LEN 1024
+#define NAME_LEN     35 /* 16 hex digits, '-', up to 6 rate digits, '-', 4 hex digits, '-', up to 2 channel digits */
+#define TEMP_LEN     18 /* the '.pid-sequence' suffix GLM_CacheStore gives temporary files, in hex */
+#define TEMP_AGE     3600 /* the age in seconds after which a temporary file is assumed to have been abandoned */
+
+#define ENTRY_NONE 0
+#define ENTRY_WAV  1
+#define ENTRY_TEMP 2
+
+typedef struct
+{ char   name[NAME_LEN+8];
+  Uint64 size;
+  time_t time;
+} Entry;
+
+static char   cacheDir[MAX_PATH_LEN];
+static Uint64 cacheLimit;
+static volatile Uint32 tempSeq;
+
+static int EntryPath(char *buffer, Uint32 size, const char *name)
+{ if(!cacheDir[0])
+  { SDL_SetError("No cache directory has been set");
+    return -1;
+  }
+  if(strlen(cacheDir)+1+strlen(name)+1 > size)
+  { SDL_SetError("Path too long");
+    return -1;
+  }
+  sprintf(buffer, "%s/%s", cacheDir, name);
+  return 0;
+}
+
+static void EntryName(char *buffer, Uint64 hash, Uint32 freq, Uint16 format, Uint8 channels)
+{ sprintf(buffer, "%08x%08x-%u-%04x-%u.wav", (unsigned)(hash>>32), (unsigned)hash, (unsigned)freq, (unsigned)format,
+          (unsigned)channels);
+}
+
+/* skips between 'min' and 'max' characters from 'set', returning NULL if there are too few */
+static const char* SkipChars(const char *p, const char *set, int min, int max)
+{ int n;
+  for(n=0; n<max && *p && strchr(set, *p); n++) p++;
+  return n<min ? NULL : p;
+}
+
+/* returns ENTRY_WAV if the file name is one made by EntryName, ENTRY_TEMP if it's a temporary file made by
+   GLM_CacheStore, or ENTRY_NONE if the file doesn't belong to the cache
+*/
+static int EntryKind(const char *name)
+{ const char *p = SkipChars(name, "0123456789abcdef", 16, 16);
+  if(!p || *p!='-' || !(p=SkipChars(p+1, "0123456789", 1, 10)) || *p!='-' ||
+     !(p=SkipChars(p+1, "0123456789abcdef", 4, 4)) || *p!='-' || !(p=SkipChars(p+1, "0123456789", 1, 3)))
+    return ENTRY_NONE;
+  if(!strcmp(p, ".wav")) return ENTRY_WAV;
+  if(*p!='.' || !(p=SkipChars(p+1, "0123456789abcdef", 1, 8)) || *p!='-' ||
+     !(p=SkipChars(p+1, "0123456789abcdef", 1, 8)) || strcmp(p, ".tmp"))
+    return ENTRY_NONE;
+  return ENTRY_TEMP;
+}
+
+static int CompareEntries(const void *a, const void *b)
+{ time_t ta = ((const Entry*)a)->time, tb = ((const Entry*)b)->time;
+  return ta<tb ? -1 : ta>tb ? 1 : 0;
+}
+
+/* deletes the least recently used entries until the cache fits within its limit, and temporary files left behind by
+   writers that didn't finish. other files in the directory are left alone
+*/
+static void Trim()
+{ Entry  *entries=NULL, *ne;
+  Uint32 count=0, capacity=0, i;
+  Uint64 total=0;
+  char   path[MAX_PATH_LEN];
+  struct stat st;
+
+  #ifdef WIN32
+  WIN32_FIND_DATAA data;
+  HANDLE find;
+  if(EntryPath(path, sizeof(path), "*")<0) return;
+  find = FindFirstFileA(path, &data);
+  if(find==INVALID_HANDLE_VALUE) return;
+  do
+  { const char *name = data.cFileName;
+  #else
+  struct dirent *de;
+  DIR *dir = opendir(cacheDir);
+  if(!dir) return;
+  while((de=readdir(dir)))
+  { const char *name = de->d_name;
+  #endif
+    int kind = EntryKind(name);
+    if(kind==ENTRY_NONE || EntryPath(path, sizeof(path), name)<0 || stat(path, &st)<0) continue;
+    if(kind==ENTRY_TEMP)
+    { if(difftime(time(NULL), st.st_mtime)>TEMP_AGE) remove(path);
+      continue;
+    }
+    if(count==capacity)
+    { capacity = capacity ? capacity*2 : 64;
+      ne = (Entry*)realloc(entries, capacity*sizeof(Entry));
+      if(!ne) break;
+      entries = ne;
+    }
+    strcpy(entries[count].name, name);
+    entries[count].size = (Uint64)st.st_size;
+    entries[count].time = st.st_mtime;
+    total += entries[count++].size;
+  #ifdef WIN32
+  } while(FindNextFileA(find, &data));
+  FindClose(find);
+  #else
+  }
+  closedir(dir);
+  #endif
+
+  if(total>cacheLimit)
+  { qsort(entries, count, sizeof(Entry), CompareEntries);
+    for(i=0; i<count && total>cacheLimit; i++)
+      if(EntryPath(path, sizeof(path), entries[i].name)==0 && remove(path)==0) total -= entries[i].size;
+  }
+  free(entries);
+}
+
+/* sets the directory where decoded audio is cached, creating it if necessary, and the maximum size of the cache in
+   bytes. a NULL directory disables the cache
+*/
+int GLM_SetCacheDirectory(const char *directory, Uint64 maxBytes)
+{ if(!directory)
+  { cacheDir[0] = 0;
+    return 0;
+  }
+  if(strlen(directory)+NAME_LEN+TEMP_LEN+8 >= MAX_PATH_LEN)
+  { SDL_SetError("Path too long");
+    return -1;
+  }
+  #ifdef WIN32
+  CreateDirectoryA(directory, NULL);
+  #else
+  mkdir(directory, 0777);
+  #endif
+  strcpy(cacheDir, directory);
+  cacheLimit = maxBytes;
+  Trim();
+  return 0;
+}
+
+/* computes a 64-bit hash (FNV-1a) of the file's contents, to be used as a cache key */
+int GLM_HashFile(const char *path, Uint64 *hash)
+{ Uint8  buffer[65536];
+  Uint64 h = 14695981039346656037ULL;
+  size_t read, i;
+  FILE   *file;
+
+  if(!path || !hash)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  file = fopen(path, "rb");
+  if(!file)
+  { SDL_SetError("Unable to open file: %s", path);
+    return -1;
+  }
+  while((read=fread(buffer, 1, sizeof(buffer), file)))
+    for(i=0; i<read; i++) h = (h^buffer[i]) * 1099511628211ULL;
+  fclose(file);
+  *hash = h;
+  return 0;
+}
+
+/* looks for an entry with the given key and format. if one exists, its path is stored in 'path' (so that it can be
+   mapped with GLM_MapWave), it's marked as recently used, and 1 is returned. otherwise, 0 is returned
+*/
+int GLM_CacheLookup(Uint64 hash, Uint32 freq, Uint16 format, Uint8 channels, char *path, Uint32 pathSize)
+{ char name[NAME_LEN+8];
+  struct stat st;
+
+  if(!path)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  EntryName(name, hash, freq, format, channels);
+  if(EntryPath(path, pathSize, name)<0) return -1;
+  if(stat(path, &st)<0) return 0;
+  utime(path, NULL); /* mark it as recently used */
+  return 1;
+}
+
+/* stores decoded audio in the cache, under the given key. the format must be AUDIO_U8 or AUDIO_S16LSB, so that the
+   entry is a valid WAV file. the entry is written to a temporary file first, so that a partial entry is never seen.
+   the temporary file is named after the process and a sequence number, so concurrent writers don't collide
+*/
+int GLM_CacheStore(Uint64 hash, Uint32 freq, Uint16 format, Uint8 channels, const void *data, Uint32 bytes)
+{ char  name[NAME_LEN+8], path[MAX_PATH_LEN], temp[MAX_PATH_LEN];
+  Uint8 header[44];
+  FILE  *file;
+  int   ok;
+  Uint32 seq;
+
+  if(!data && bytes)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if((format!=AUDIO_U8 && format!=AUDIO_S16LSB) || !channels || !freq)
+  { SDL_SetError("Unsupported format");
+    return -1;
+  }
+  EntryName(name, hash, freq, format, channels);
+  if(EntryPath(path, sizeof(path), name)<0) return -1;
+  do seq = tempSeq; while(!GLM_CAS(&tempSeq, seq, seq+1));
+  strcpy(temp, path);
+  #ifdef WIN32
+  sprintf(temp+strlen(temp)-4, ".%x-%x.tmp", (unsigned)GetCurrentProcessId(), (unsigned)seq);
+  #else
+  sprintf(temp+strlen(temp)-4, ".%x-%x.tmp", (unsigned)getpid(), (unsigned)seq);
+  #endif
+
+  GLM_writeWaveHeader(header, freq, format, channels, bytes);
+
+  file = fopen(temp, "wb");
+  if(!file)
+  { SDL_SetError("Unable to create file: %s", temp);
+    return -1;
+  }
+  ok = fwrite(header, sizeof(header), 1, file)==1 && (!bytes || fwrite(data, bytes, 1, file)==1);
+  if(fclose(file)!=0) ok=0;
+  #ifdef WIN32
+  if(ok) ok = MoveFileExA(temp, path, MOVEFILE_REPLACE_EXISTING);
+  #else
+  if(ok) ok = rename(temp, path)==0;
+  #endif
+  if(!ok)
+  { remove(temp);
+    SDL_SetError("Unable to write file: %s", path);
+    return -1;
+  }
+  Trim();
+  return 0;
+}
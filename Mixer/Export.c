@@ -0,0 +1,204 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* publishing of the mixer's output in shared memory, so that other processes (analyzers, test tools, etc.) can tap it
+   without the game doing any IPC. the mapping starts with a GLM_ExportHeader (see Mixer.h), followed by a ring for
+   the output and a ring for each bus stem. the mix callback copies each buffer into the rings and advances the write
+   index; it never waits for readers, so a reader that falls more than a ring behind loses audio, and can tell that it
+   has from the write index.
+*/
+
+#include "Internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define STREAM_ALIGN 64
+
+static GLM_ExportHeader *header;
+static Uint32 mapSize, frameSize, mask;
+static volatile int exporting;
+#ifdef WIN32
+static HANDLE mapping;
+#else
+static char shmName[256];
+#endif
+
+static void FillSilence(Uint8 *dest, Uint32 bytes, Uint16 format)
+{ if(SIGNED(format) || FLOAT(format)) memset(dest, 0, bytes);
+  else if(BITS(format)==8) memset(dest, 128, bytes);
+  else
+  { Uint16 silence = 32768, *buf = (Uint16*)dest;
+    Uint32 i;
+    if(OPPEND(format)) silence = (Uint16)SWAPEND(silence);
+    for(i=0; i<bytes/2; i++) buf[i] = silence;
+  }
+}
+
+/* copies 'frames' frames into the ring for 'stream' at the current write position. either 'data' (in the output
+   format) or 'acc' (in the accumulator format) should be given. if neither is, silence is written
+*/
+static void WriteStream(Uint32 stream, const Uint8 *data, Sint32 *acc, Uint32 frames)
+{ Uint8  *ring = (Uint8*)header + header->headerSize + stream*header->streamBytes;
+  Uint32 start = header->writeFrame&mask, first = mask+1-start, part;
+
+  for(part=0; part<2 && frames; part++)
+  { Uint32 n = frames<first ? frames : first;
+    Uint8  *dest = ring + start*frameSize;
+    if(data) memcpy(dest, data, n*frameSize), data += n*frameSize;
+    else if(acc) GLM_ConvertAcc(dest, acc, n*header->channels, header->format), acc += n*header->channels;
+    else FillSilence(dest, n*frameSize, header->format);
+    frames -= n, start = 0, first = mask+1;
+  }
+}
+
+void GLM_exportOutput(const Uint8 *data, Uint32 bytes, int mixed)
+{ Uint32 frames, i;
+  if(!exporting) return;
+
+  frames = bytes/frameSize;
+  if(frames>header->bufferFrames) frames = header->bufferFrames; /* shouldn't happen */
+  WriteStream(0, data, NULL, frames);
+  for(i=1; i<header->streams; i++)
+    WriteStream(i, NULL, mixed ? GLM_getBusOutput(header->stemBuses[i-1]) : NULL, frames);
+
+  GLM_BARRIER(); /* publish the data before the index */
+  header->sequence++;
+  GLM_BARRIER();
+  header->writeTime   = GLM_microseconds();
+  header->writeFrame += frames;
+  GLM_BARRIER();
+  header->sequence++;
+}
+
+static void Unmap()
+{
+  #ifdef WIN32
+  UnmapViewOfFile(header);
+  CloseHandle(mapping);
+  #else
+  munmap(header, mapSize);
+  shm_unlink(shmName);
+  #endif
+  header = NULL;
+}
+
+/* starts publishing the mixer's output in a shared memory object with the given name (which should start with a
+   slash on POSIX systems). each ring holds at least 'bufferMs' milliseconds of audio. 'stems' lists the buses (up to
+   GLM_MAX_STEMS) whose output is published after the main output, and may be NULL if 'stemCount' is zero. any current
+   export is stopped first
+*/
+int GLM_StartExport(const char *name, Uint32 bufferMs, const Uint32 *stems, Uint32 stemCount)
+{ Uint32 freq, bufferBytes, frames, headerSize, streamBytes, i;
+  Uint16 format;
+  Uint8  channels;
+
+  if(!name || (!stems && stemCount))
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(stemCount>GLM_MAX_STEMS)
+  { SDL_SetError("Too many stems");
+    return -1;
+  }
+  if(GLM_GetFormat(&freq, &format, &channels, &bufferBytes)<0) return -1;
+  GLM_StopExport();
+
+  frameSize = BYTES(format)*channels;
+  for(frames=1024; frames<(Uint64)freq*bufferMs/1000 || frames<bufferBytes/frameSize*2; frames<<=1);
+  headerSize  = (sizeof(GLM_ExportHeader)+STREAM_ALIGN-1) & ~(STREAM_ALIGN-1);
+  streamBytes = (frames*frameSize+STREAM_ALIGN-1) & ~(STREAM_ALIGN-1);
+  mapSize     = headerSize + streamBytes*(stemCount+1);
+
+  #ifdef WIN32
+  mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, mapSize, name);
+  if(!mapping) goto error;
+  header = (GLM_ExportHeader*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, mapSize);
+  if(!header)
+  { CloseHandle(mapping);
+    goto error;
+  }
+  #else
+  { int fd;
+    void *base;
+    if(strlen(name)>=sizeof(shmName))
+    { SDL_SetError("Name too long");
+      return -1;
+    }
+    fd = shm_open(name, O_CREAT|O_RDWR, 0644);
+    if(fd<0) goto error;
+    if(ftruncate(fd, 0)<0 || ftruncate(fd, mapSize)<0) /* truncate first, to zero any old contents */
+    { close(fd);
+      shm_unlink(name);
+      goto error;
+    }
+    base = mmap(NULL, mapSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping keeps the object open */
+    if(base==MAP_FAILED)
+    { shm_unlink(name);
+      goto error;
+    }
+    header = (GLM_ExportHeader*)base;
+    strcpy(shmName, name);
+  }
+  #endif
+
+  memset(header, 0, headerSize);
+  header->version      = GLM_EXPORT_VERSION;
+  header->headerSize   = headerSize;
+  header->freq         = freq;
+  header->format       = format;
+  header->channels     = channels;
+  header->streams      = (Uint8)(stemCount+1);
+  header->frames       = frames;
+  header->streamBytes  = streamBytes;
+  header->bufferFrames = bufferBytes/frameSize;
+  for(i=0; i<stemCount; i++) header->stemBuses[i] = stems[i];
+  for(i=0; i<=stemCount; i++)
+    FillSilence((Uint8*)header+headerSize+i*streamBytes, frames*frameSize, format);
+  mask = frames-1;
+  GLM_BARRIER();
+  header->magic = GLM_EXPORT_MAGIC; /* readers should wait for the magic number */
+  GLM_BARRIER();
+  exporting = 1;
+  return 0;
+
+  error:
+  SDL_SetError("Unable to create shared memory: %s", name);
+  return -1;
+}
+
+/* stops publishing the output and removes the shared memory object. readers that still have it mapped see the magic
+   number cleared
+*/
+int GLM_StopExport()
+{ if(!header) return 0;
+  GLM_LockAudio(); /* make sure the callback isn't in the middle of writing a buffer */
+  exporting = 0;
+  GLM_UnlockAudio();
+  header->magic = 0;
+  Unmap();
+  return 0;
+}
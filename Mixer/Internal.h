@@ -0,0 +1,120 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* definitions shared between the mixer's source files. nothing in here is exported */
+
+#ifndef GAMELIB_MIXER_INTERNAL_H
+#define GAMELIB_MIXER_INTERNAL_H
+
+#include "Mixer.h"
+
+#define BITS(fmt) ((fmt)&0xFF)
+#define BYTES(fmt) (BITS(fmt)>>3)
+#define DIVISIBLE(n, d) ((n)/(d)*(d)==(n))
+#define SIGNED(fmt) ((fmt)&0x8000)
+#define FLOAT(fmt)  ((fmt)&0x4000)
+#define SWAPEND(v) (((v)<<8)|((v)>>8))
+#define MAXALLOCA 60000
+
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+  #define OPPEND(fmt) ((fmt)&0x1000)
+  #define MAKESE(fmt) (fmt&~0x1000)
+#else
+  #define OPPEND(fmt) (!((fmt)&0x1000))
+  #define MAKESE(fmt) (fmt|0x1000)
+#endif
+
+/* an output backend. the mixer calls open() from GLM_InitEx, and the backend arranges for spec->callback to be called
+   whenever it needs more data. lock() and unlock() must exclude the callback.
+*/
+typedef struct
+{ int  (*open)(SDL_AudioSpec *desired, SDL_AudioSpec *obtained, const char *arg);
+  void (*close)(void);
+  void (*pause)(int pause);
+  void (*lock)(void);
+  void (*unlock)(void);
+} GLM_Backend;
+
+extern const GLM_Backend GLM_sdlBackend, GLM_nullBackend, GLM_waveBackend;
+
+/* atomic operations for the lock-free structures. GLM_CAS returns true if *p was 'old' and has been replaced */
+#ifdef _MSC_VER
+long __cdecl _InterlockedCompareExchange(long volatile *dest, long exchange, long comparand);
+void _ReadWriteBarrier(void);
+#pragma intrinsic(_InterlockedCompareExchange, _ReadWriteBarrier)
+#define GLM_CAS(p, old, new) (_InterlockedCompareExchange((long volatile*)(p), (long)(new), (long)(old))==(long)(old))
+#define GLM_BARRIER() _ReadWriteBarrier()
+#else
+#define GLM_CAS(p, old, new) __sync_bool_compare_and_swap((p), (old), (new))
+#define GLM_BARRIER() __sync_synchronize()
+#endif
+
+/* returns a monotonic time in microseconds */
+Uint64 GLM_microseconds();
+
+/* applies the GLM_THREAD_* policy to the calling thread if it differs from the generation in '*applied'. threads that
+   run mixer code should call this periodically, starting with *applied==0
+*/
+void GLM_applyThreadPolicy(int thread, Uint32 *applied);
+
+/* called by the mixer around the mix callback to prepare the submix buses and sum any that the callback didn't */
+void GLM_clearBuses(Uint32 samples);
+void GLM_finishBuses(Sint32 *dest, Uint32 frames);
+void GLM_freeBuses();
+Sint32* GLM_getBusOutput(Uint32 bus);
+
+/* called by the mixer with each finished output buffer, to feed the recorder and the shared-memory export. 'mixed'
+   is false if the buffer is silent because the mix was skipped
+*/
+void GLM_recordOutput(const Uint8 *data, Uint32 bytes);
+void GLM_exportOutput(const Uint8 *data, Uint32 bytes, int mixed);
+
+/* fills in the 44-byte header of a PCM WAV file holding 'dataBytes' bytes of sample data */
+void GLM_writeWaveHeader(Uint8 header[44], Uint32 freq, Uint16 format, Uint8 channels, Uint32 dataBytes);
+
+/* reads a sample of any supported format on a signed 16-bit scale. integer samples are returned exactly, and float
+   samples are multiplied by 32768 without being clipped
+*/
+float GLM_readSample(const Uint8 *p, Uint16 format);
+
+/* called by the mixer before the mix callback to apply pending group commands to the voice controls (for every
+   buffer, even when the mix is skipped), and to move the voices' automation forward by a buffer
+*/
+void GLM_processGroups();
+void GLM_processAutomation(Uint32 frames);
+
+/* a breakpoint envelope, with times converted to frames */
+typedef struct
+{ Uint32 frames[GLM_MAX_BREAKPOINTS];
+  float  values[GLM_MAX_BREAKPOINTS];
+  Uint8  curves[GLM_MAX_BREAKPOINTS];
+  Uint32 count;
+} GLM_Points;
+
+typedef struct
+{ GLM_Points      active, pending;
+  volatile Uint32 seq;   /* incremented before and after 'pending' is written, so it's odd during a write */
+  Uint32          taken; /* the sequence number of the points in 'active' */
+  Uint32          pos, start, segment; /* the position in frames, the position at the start of the buffer, and the
+                                          first point after the start of the buffer */
+} GLM_Envelope;
+
+int   GLM_setEnvelope(GLM_Envelope *env, const GLM_Breakpoint *points, Uint32 count, Uint32 freq, float min, float max);
+int   GLM_advanceEnvelope(GLM_Envelope *env, Uint32 frames);
+float GLM_evalEnvelope(const GLM_Envelope *env, Uint32 offset);
+
+#endif /* GAMELIB_MIXER_INTERNAL_H */
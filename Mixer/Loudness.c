@@ -0,0 +1,216 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* offline loudness analysis, following EBU R128 / ITU-R BS.1770. each sound is K-weighted (a high shelf followed by a
+   high-pass, with the coefficients derived for its sample rate), its mean square is measured over 400ms blocks with 75%
+   overlap, and the blocks are gated at -70 LUFS and then 10 LU below the ungated level to get the integrated loudness.
+   the true peak is measured by oversampling by four. a batch of sounds is split between worker threads, which claim
+   sounds one at a time, so that long and short sounds balance out.
+*/
+
+#include "Internal.h"
+#include "SDL_thread.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PI           3.14159265358979
+#define OVERSAMPLE   4
+#define PEAK_TAPS    12 /* the number of taps per phase of the oversampling filter */
+#define MAX_THREADS  16
+#define ABSOLUTE_GATE (-70.0)
+#define RELATIVE_GATE (-10.0)
+
+typedef struct
+{ GLM_LoudnessJob *jobs;
+  Uint32          count;
+  volatile Uint32 next; /* the next job to be claimed */
+  float           target, ceiling;
+} Batch;
+
+static float peakFilter[OVERSAMPLE][PEAK_TAPS]; /* the polyphase interpolation filter */
+static int   peakFilterReady;
+
+/* builds the oversampling filter, a windowed sinc with its cutoff at the original Nyquist frequency */
+static void InitPeakFilter()
+{ int phase, tap;
+  if(peakFilterReady) return;
+  for(phase=0; phase<OVERSAMPLE; phase++)
+    for(tap=0; tap<PEAK_TAPS; tap++)
+    { double n = tap*OVERSAMPLE + phase, center = (PEAK_TAPS*OVERSAMPLE-1)*0.5, x = (n-center)/OVERSAMPLE;
+      double sinc = x==0 ? 1 : sin(PI*x)/(PI*x), window = 0.5-0.5*cos(2*PI*(n+0.5)/(PEAK_TAPS*OVERSAMPLE));
+      peakFilter[phase][tap] = (float)(sinc*window);
+    }
+  peakFilterReady = 1;
+}
+
+static int SupportedFormat(Uint16 format)
+{ return FLOAT(format) ? BITS(format)==32 || BITS(format)==64 : BITS(format)==8 || BITS(format)==16;
+}
+
+/* returns the BS.1770 weight of the channel. the LFE channel of 5.1 sound is ignored, and the surrounds count more */
+static double ChannelWeight(int channel, int channels)
+{ if(channels!=6 || channel<3) return 1;
+  return channel==3 ? 0 : 1.41;
+}
+
+static double ToLufs(double meanSquare) { return -0.691 + 10*log10(meanSquare); }
+
+static void Analyze(GLM_LoudnessJob *job, float target, float ceiling)
+{ double b[2][3], a[2][3], K, Vh, Vb, a0, *subBlocks, sum, threshold;
+  float  history[8][PEAK_TAPS], peak=0;
+  double state[8][2][2]; /* the biquad states for each channel and stage */
+  Uint32 sampleSize = BYTES(job->format), frameSize = sampleSize*job->channels, subBlockFrames = job->freq/10;
+  Uint32 subCount = subBlockFrames ? job->frames/subBlockFrames : 0, blocks, used, i, f;
+  const Uint8 *p = (const Uint8*)job->data;
+  int c, s, t, phase, channels = job->channels;
+
+  job->loudness = (float)-HUGE_VAL;
+  job->truePeak = (float)-HUGE_VAL;
+  job->gain     = 1;
+  if(!job->frames) return;
+
+  /* the K-weighting filter, derived for the sample rate by the bilinear transform */
+  K  = tan(PI*1681.974450955533/job->freq);
+  Vh = pow(10, 3.999843853973347/20);
+  Vb = pow(Vh, 0.4996667741545416);
+  a0 = 1 + K/0.7071752369554196 + K*K;
+  b[0][0] = (Vh + Vb*K/0.7071752369554196 + K*K)/a0;
+  b[0][1] = 2*(K*K - Vh)/a0;
+  b[0][2] = (Vh - Vb*K/0.7071752369554196 + K*K)/a0;
+  a[0][1] = 2*(K*K - 1)/a0;
+  a[0][2] = (1 - K/0.7071752369554196 + K*K)/a0;
+  K  = tan(PI*38.13547087602444/job->freq);
+  a0 = 1 + K/0.5003270373238773 + K*K;
+  b[1][0] = 1, b[1][1] = -2, b[1][2] = 1;
+  a[1][1] = 2*(K*K - 1)/a0;
+  a[1][2] = (1 - K/0.5003270373238773 + K*K)/a0;
+
+  if(subCount<4) subCount = 1, subBlockFrames = job->frames; /* too short to gate, so measure it as one block */
+  subBlocks = (double*)calloc(subCount, sizeof(double));
+  if(!subBlocks) return;
+  memset(state, 0, sizeof(state));
+  memset(history, 0, sizeof(history));
+
+  for(f=0; f<job->frames; p+=frameSize,f++)
+  { Uint32 sub = f/subBlockFrames;
+    for(c=0; c<channels; c++)
+    { double x = GLM_readSample(p+c*sampleSize, job->format)*(1.0/32768), weight = ChannelWeight(c, channels), y;
+      float  *h = history[c];
+
+      /* the true peak, from the sample interpolated at each phase */
+      memmove(h, h+1, (PEAK_TAPS-1)*sizeof(float));
+      h[PEAK_TAPS-1] = (float)x;
+      for(phase=0; phase<OVERSAMPLE; phase++)
+      { float v=0;
+        for(t=0; t<PEAK_TAPS; t++) v += h[t]*peakFilter[phase][PEAK_TAPS-1-t];
+        if(v<0) v=-v;
+        if(v>peak) peak=v;
+      }
+
+      if(sub>=subCount || !weight) continue; /* the partial block at the end is only used for the peak */
+      for(s=0; s<2; s++) /* transposed direct form II */
+      { y = b[s][0]*x + state[c][s][0];
+        state[c][s][0] = b[s][1]*x - a[s][1]*y + state[c][s][1];
+        state[c][s][1] = b[s][2]*x - a[s][2]*y;
+        x = y;
+      }
+      subBlocks[sub] += weight*x*x;
+    }
+  }
+
+  /* each 400ms block is four 100ms sub-blocks, and the blocks step by one sub-block */
+  blocks = subCount<4 ? 1 : subCount-3;
+  for(i=0; i<subCount; i++) subBlocks[i] /= subBlockFrames;
+  if(subCount>=4) /* block i replaces sub-block i, which no later block needs */
+    for(i=0; i<blocks; i++) subBlocks[i] = (subBlocks[i]+subBlocks[i+1]+subBlocks[i+2]+subBlocks[i+3]) * 0.25;
+
+  threshold = pow(10, (ABSOLUTE_GATE+0.691)/10);
+  for(sum=0,used=0,i=0; i<blocks; i++) if(subBlocks[i]>threshold) sum += subBlocks[i], used++;
+  if(used)
+  { double relative = sum/used * pow(10, RELATIVE_GATE/10);
+    if(relative>threshold) threshold = relative;
+    for(sum=0,used=0,i=0; i<blocks; i++) if(subBlocks[i]>threshold) sum += subBlocks[i], used++;
+  }
+  free(subBlocks);
+
+  if(peak>0) job->truePeak = (float)(20*log10(peak));
+  if(used)
+  { double gain;
+    job->loudness = (float)ToLufs(sum/used);
+    gain = target - job->loudness;
+    if(peak>0 && job->truePeak+gain>ceiling) gain = ceiling - job->truePeak; /* don't push the peaks past the ceiling */
+    job->gain = (float)pow(10, gain/20);
+  }
+}
+
+/* claims and analyzes jobs until there are none left */
+static void RunJobs(Batch *batch)
+{ Uint32 job;
+  while(1)
+  { do
+    { job = batch->next;
+      if(job>=batch->count) return;
+    } while(!GLM_CAS(&batch->next, job, job+1));
+    Analyze(batch->jobs+job, batch->target, batch->ceiling);
+  }
+}
+
+static int WorkerThread(void *context)
+{ Uint32 applied=0;
+  GLM_applyThreadPolicy(GLM_THREAD_WORKER, &applied);
+  RunJobs((Batch*)context);
+  return 0;
+}
+
+/* measures the integrated loudness (in LUFS) and true peak (in dBTP) of each sound, and computes the gain that would
+   bring it to the target loudness without its true peak exceeding the ceiling (in dBTP). the sounds are divided between
+   up to 'threads' threads, including the calling thread. silent sounds get a loudness and peak of -HUGE_VAL and a gain
+   of 1. the formats may be 8-bit or 16-bit integers, or floats, with up to 8 channels
+*/
+int GLM_AnalyzeLoudness(GLM_LoudnessJob *jobs, Uint32 count, float target, float ceiling, Uint32 threads)
+{ SDL_Thread *workers[MAX_THREADS];
+  Batch  batch;
+  Uint32 i, started;
+
+  if(!jobs && count)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  for(i=0; i<count; i++)
+  { if(!jobs[i].data && jobs[i].frames)
+    { SDL_SetError("NULL pointer passed");
+      return -1;
+    }
+    if(!SupportedFormat(jobs[i].format) || !jobs[i].channels || jobs[i].channels>8 || !jobs[i].freq)
+    { SDL_SetError("Unsupported format");
+      return -1;
+    }
+  }
+
+  InitPeakFilter();
+  batch.jobs = jobs, batch.count = count, batch.next = 0, batch.target = target, batch.ceiling = ceiling;
+  if(threads>MAX_THREADS) threads = MAX_THREADS;
+  if(threads>count) threads = count;
+  for(started=0; started+1<threads; started++) /* if a thread can't be started, the others take its share */
+  { workers[started] = SDL_CreateThread(WorkerThread, &batch);
+    if(!workers[started]) break;
+  }
+  RunJobs(&batch); /* the calling thread takes a share too, under its own policy */
+  for(i=0; i<started; i++) SDL_WaitThread(workers[i], NULL);
+  return 0;
+}
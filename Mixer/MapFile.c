@@ -0,0 +1,216 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* memory-mapped sound files. uncompressed WAV and raw files are mapped read-only, so that the mixer can read samples
+   straight out of the page cache without copying them through a stream first. the mapping is marked as sequential so
+   that the OS reads ahead of playback and drops pages behind it.
+*/
+
+#include "Internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define READAHEAD 262144 /* the number of bytes to read ahead when a file is opened */
+
+struct GLM_MappedFile
+{ Uint8  *base;
+  Uint32 size;
+  #ifdef WIN32
+  HANDLE file, mapping;
+  #endif
+};
+
+static Uint32 ReadLE(const Uint8 *buf, int bytes)
+{ Uint32 value=0;
+  while(bytes--) value = (value<<8) | buf[bytes];
+  return value;
+}
+
+static GLM_MappedFile* MapFile(const char *path)
+{ GLM_MappedFile *file;
+
+  if(!path)
+  { SDL_SetError("NULL pointer passed");
+    return NULL;
+  }
+  file = (GLM_MappedFile*)calloc(1, sizeof(GLM_MappedFile));
+  if(!file)
+  { SDL_SetError("Out of memory");
+    return NULL;
+  }
+
+  #ifdef WIN32
+  file->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if(file->file==INVALID_HANDLE_VALUE) goto error;
+  file->size = GetFileSize(file->file, NULL);
+  if(file->size==INVALID_FILE_SIZE || !file->size) goto error;
+  file->mapping = CreateFileMapping(file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if(!file->mapping) goto error;
+  file->base = (Uint8*)MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+  if(!file->base) goto error;
+  return file;
+
+  error:
+  if(file->mapping) CloseHandle(file->mapping);
+  if(file->file && file->file!=INVALID_HANDLE_VALUE) CloseHandle(file->file);
+  #else
+  { struct stat st;
+    void *base;
+    int fd = open(path, O_RDONLY);
+    if(fd<0) goto error;
+    if(fstat(fd, &st)<0 || !st.st_size || (Uint64)st.st_size>0xFFFFFFFF) { close(fd); goto error; }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping keeps the file open */
+    if(base==MAP_FAILED) goto error;
+    file->base = (Uint8*)base, file->size = (Uint32)st.st_size;
+    madvise(base, file->size, MADV_SEQUENTIAL);
+    return file;
+  }
+
+  error:
+  #endif
+  SDL_SetError("Unable to map file: %s", path);
+  free(file);
+  return NULL;
+}
+
+/* maps an uncompressed 8-bit or 16-bit PCM WAV file, and fills in 'info' with its format and sample data */
+GLM_MappedFile* GLM_MapWave(const char *path, GLM_MapInfo *info)
+{ GLM_MappedFile *file;
+  const Uint8 *p, *end;
+  Uint32 size, bits=0;
+
+  if(!info)
+  { SDL_SetError("NULL pointer passed");
+    return NULL;
+  }
+  file = MapFile(path);
+  if(!file) return NULL;
+
+  p = file->base, end = p+file->size;
+  if(file->size<12 || memcmp(p, "RIFF", 4) || memcmp(p+8, "WAVE", 4)) goto notwave;
+  memset(info, 0, sizeof(GLM_MapInfo));
+  for(p+=12; end-p>=8; p += 8+size+(size&1)) /* chunks are padded to an even size */
+  { size = ReadLE(p+4, 4);
+    if((Uint32)(end-p-8)<size && memcmp(p, "data", 4)) goto notwave;
+    if(!memcmp(p, "fmt ", 4))
+    { Uint32 tag;
+      if(size<16) goto notwave;
+      tag  = ReadLE(p+8, 2);
+      bits = ReadLE(p+22, 2);
+      if(tag!=1 && !(tag==0xFFFE && size>=26 && ReadLE(p+32, 2)==1)) goto unsupported; /* PCM or extensible PCM */
+      if(bits!=8 && bits!=16) goto unsupported;
+      info->channels = (Uint8)ReadLE(p+10, 2);
+      info->freq     = ReadLE(p+12, 4);
+      info->format   = bits==8 ? AUDIO_U8 : AUDIO_S16LSB;
+      if(!info->channels || !info->freq) goto notwave;
+    }
+    else if(!memcmp(p, "data", 4))
+    { if(!bits) goto notwave; /* the format must come first */
+      if((Uint32)(end-p-8)<size) size = (Uint32)(end-p-8); /* truncated file */
+      info->data  = p+8;
+      info->bytes = size - size%(info->channels*(bits/8));
+      break;
+    }
+  }
+  if(!info->data) goto notwave;
+  GLM_AdviseMapping(file, info->data, READAHEAD);
+  return file;
+
+  unsupported:
+  GLM_UnmapFile(file);
+  SDL_SetError("Unsupported WAV format: %s", path);
+  return NULL;
+
+  notwave:
+  GLM_UnmapFile(file);
+  SDL_SetError("Not a valid WAV file: %s", path);
+  return NULL;
+}
+
+/* maps a raw sound file, using 'length' bytes starting at 'offset' (or the rest of the file if 'length' is zero).
+   'info' should be filled in with the data format, and its data pointer and size are filled in
+*/
+GLM_MappedFile* GLM_MapRaw(const char *path, Uint32 offset, Uint32 length, GLM_MapInfo *info)
+{ GLM_MappedFile *file;
+  Uint32 frameSize;
+
+  if(!info)
+  { SDL_SetError("NULL pointer passed");
+    return NULL;
+  }
+  frameSize = BYTES(info->format)*info->channels;
+  if(!frameSize)
+  { SDL_SetError("Invalid format");
+    return NULL;
+  }
+  file = MapFile(path);
+  if(!file) return NULL;
+  if(offset>file->size || length>file->size-offset)
+  { GLM_UnmapFile(file);
+    SDL_SetError("The data extends past the end of the file");
+    return NULL;
+  }
+  if(!length) length = file->size-offset;
+  info->data  = file->base+offset;
+  info->bytes = length - length%frameSize;
+  GLM_AdviseMapping(file, info->data, READAHEAD);
+  return file;
+}
+
+void GLM_UnmapFile(GLM_MappedFile *file)
+{ if(!file) return;
+  #ifdef WIN32
+  UnmapViewOfFile(file->base);
+  CloseHandle(file->mapping);
+  CloseHandle(file->file);
+  #else
+  munmap(file->base, file->size);
+  #endif
+  free(file);
+}
+
+/* hints that the given range of the mapping will be played soon, eg, after seeking. the OS will start reading it in
+   the background, rather than making the mixer wait for it
+*/
+int GLM_AdviseMapping(GLM_MappedFile *file, const void *data, Uint32 bytes)
+{ Uint32 offset;
+  if(!file || !data)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if((const Uint8*)data<file->base || (const Uint8*)data>=file->base+file->size) return 0;
+  offset = (Uint32)((const Uint8*)data-file->base);
+  if(bytes>file->size-offset) bytes = file->size-offset;
+  #ifndef WIN32
+  { long   page  = sysconf(_SC_PAGESIZE);
+    Uint32 start = offset - offset%(Uint32)page;
+    madvise(file->base+start, bytes+(offset-start), MADV_WILLNEED);
+  }
+  #endif
+  return 0;
+}
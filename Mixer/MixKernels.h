@@ -0,0 +1,53 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* the kernels that mix integer samples into the accumulator, written once and instantiated by Mixer.c for each
+   integer sample type. this file has no include guard, since it's included once per instantiation, with these macros
+   defined:
+     KERNEL   the suffix for the names of the generated functions, eg S16
+     SAMPLE   the type of a sample in memory
+     LOAD(p)  reads the sample at p as a signed int centered on zero, swapping its bytes if necessary
+   all of them are left to the includer to undefine.
+*/
+
+#define MK_CAT2(name, kernel) name##_##kernel
+#define MK_CAT(name, kernel) MK_CAT2(name, kernel)
+#define MK_NAME(name) MK_CAT(name, KERNEL)
+
+/* mixes samples into the accumulator, scaled by vol (256 = unity, and higher values amplify) */
+static void MK_NAME(MixMono)(Sint32 *dest, const void *data, Uint32 samples, int vol)
+{ const SAMPLE *src = (const SAMPLE*)data;
+  register Uint32 i;
+  if(vol==256) for(i=0; i<samples; i++) dest[i]+=LOAD(src+i);
+  else for(i=0; i<samples; i++) dest[i]+=(LOAD(src+i)*vol)>>8;
+}
+
+/* mixes interleaved stereo samples into the accumulator, scaling the left and right channels separately */
+static void MK_NAME(MixStereo)(Sint32 *dest, const void *data, Uint32 samples, int left, int right)
+{ const SAMPLE *src = (const SAMPLE*)data;
+  register Uint32 i;
+  if(left==256 && right==256) for(i=0; i<samples; i++) dest[i]+=LOAD(src+i);
+  else
+    for(i=0; i<samples; i+=2)
+    { dest[i]  +=(LOAD(src+i)*left)>>8;
+      dest[i+1]+=(LOAD(src+i+1)*right)>>8;
+    }
+}
+
+#undef MK_NAME
+#undef MK_CAT
+#undef MK_CAT2
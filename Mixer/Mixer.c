@@ -15,42 +15,68 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
-#include "Mixer.h"
+#include "Internal.h"
 #include <stdlib.h>
 #include <string.h>
 #include <malloc.h>
 
-#define BITS(fmt) ((fmt)&0xFF)
-#define BYTES(fmt) (BITS(fmt)>>3)
-#define DIVISIBLE(n, d) ((n)/(d)*(d)==(n))
-#define SIGNED(fmt) ((fmt)&0x8000)
-#define FLOAT(fmt)  ((fmt)&0x4000)
-#define SWAPEND(v) (((v)<<8)|((v)>>8))
-#define MAXALLOCA 60000
-
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-  #define OPPEND(fmt) ((fmt)&0x1000)
-  #define MAKESE(fmt) (fmt&~0x1000)
-#else
-  #define OPPEND(fmt) (!((fmt)&0x1000))
-  #define MAKESE(fmt) (fmt|0x1000)
-#endif
-
 static SDL_AudioSpec mixFormat;
+static const GLM_Backend *backend;
 static MixCallback   mixCallback;
 static Sint32       *mixAcc;
 static Sint32        mixAccSize;
 static int           initCount, mixVolume=256;
+static Uint32        audioPolicy; /* the generation of the thread policy applied to the audio thread */
+
+/* load tracking. the level rises by one step for every buffer whose smoothed cost is over budget, and falls by one step
+   after every LOAD_RECOVERY consecutive buffers comfortably under it
+*/
+#define LOAD_RECOVERY 16
+static GLM_LoadStats loadStats;
+static Uint32        loadBudget=750, loadCalm;
+static Sint32        lodThresholds[3] = { 128, 48, 12 }, lodWeight=16;
+
+static void UpdateLoad(Uint32 frames, Uint32 cost)
+{ Uint32 period = (Uint32)((Uint64)frames*1000000/mixFormat.freq), load;
+  if(!period) return;
+
+  load = (Uint32)((Uint64)cost*1000/period);
+  if(load>65535) load=65535;
+  loadStats.buffers++;
+  loadStats.lastCost = cost;
+  if(cost>loadStats.peakCost) loadStats.peakCost=cost;
+  if(cost>period) loadStats.overruns++;
+
+  if(load>loadStats.load) loadStats.load = (Uint16)((loadStats.load+load)/2); /* rise quickly and fall slowly */
+  else loadStats.load -= (Uint16)((loadStats.load-load)/16);
+
+  if(loadBudget && loadStats.load>loadBudget)
+  { if(loadStats.level<GLM_LOAD_CRITICAL) loadStats.level++;
+    loadCalm=0;
+  }
+  else if(loadStats.load<loadBudget*2/3)
+  { if(loadStats.level && ++loadCalm>=LOAD_RECOVERY) loadStats.level--, loadCalm=0;
+  }
+  else loadCalm=0;
+  if(loadStats.level) loadStats.degraded++;
+}
 
 static void GLM_callback(void *userdata, Uint8 *stream, int bytes)
 { int samples, frames;
+  Uint64 start;
   if(!mixCallback) return;
 
+  GLM_applyThreadPolicy(GLM_THREAD_AUDIO, &audioPolicy);
+  start   = GLM_microseconds();
+  samples = bytes/BYTES(mixFormat.format);
+  frames  = samples/mixFormat.channels;
+  GLM_processGroups(); /* even while muted, so that the command queue doesn't fill up */
   if(mixVolume>0)
-  { samples = bytes/BYTES(mixFormat.format);
-    frames  = samples/mixFormat.channels;
-    memset(mixAcc, 0, samples*sizeof(Sint32)); /* zero the accumulator */
+  { memset(mixAcc, 0, samples*sizeof(Sint32)); /* zero the accumulator */
+    GLM_processAutomation(frames);
+    GLM_clearBuses(samples);
     mixCallback(mixAcc, frames, userdata);  /* call the user callback to mix in the audio */
+    GLM_finishBuses(mixAcc, frames);
     if(mixVolume<256) GLM_VolumeScale(mixAcc, samples, mixVolume, mixVolume);
     GLM_ConvertAcc(stream, mixAcc, samples, mixFormat.format);
   }
@@ -61,6 +87,9 @@ static void GLM_callback(void *userdata, Uint8 *stream, int bytes)
     int     i, len = bytes/2;
     for(i=0; i<len; i++) buf[i]=32768;
   }
+  GLM_recordOutput(stream, bytes);
+  GLM_exportOutput(stream, bytes, mixVolume>0);
+  UpdateLoad(frames, (Uint32)(GLM_microseconds()-start));
 }
 
 static void StereoToMono(GLM_AudioCVT *cvt)
@@ -84,14 +113,14 @@ static void StereoToMono(GLM_AudioCVT *cvt)
       if(SIGNED(sfmt)) /* 16bit signed OE */
       { Sint16 *dest = (Sint16*)cvt->buf;
         for(; i; src+=2,i--)
-        { dv = (Uint32)(((Sint32)SWAPEND(src[0])+(Sint32)SWAPEND(src[1]))/2);
+        { dv = (Uint32)(((Sint16)SWAPEND(src[0])+(Sint16)SWAPEND(src[1]))/2);
           *dest++ = SWAPEND(dv);
         }
       }
       else /* 16bit unsigned OE */
       { Uint16 *dest = (Uint16*)cvt->buf;
         for(; i; src+=2,i--)
-        { dv = (SWAPEND(src[0])+SWAPEND(src[1]))/2;
+        { dv = ((Uint16)SWAPEND(src[0])+(Uint16)SWAPEND(src[1]))/2;
           *dest++ = SWAPEND(dv);
         }
       }
@@ -253,7 +282,7 @@ static void IntegerToFloat(GLM_AudioCVT *cvt)
       if(OPPEND(cvt->srcFormat)) /* from 16-bit opposite endianness */
       { Uint16 *src = (Uint16*)(cvt->buf+cvt->len-2);
         if(SIGNED(cvt->srcFormat)) for(; i; src--,i--) *dest-- = (Sint16)SWAPEND(*src) / 32768.0f; /* from 16-bit signed OE */
-        else for(; i; src--,i--) *dest-- = ((Sint16)SWAPEND(*src)-32768) / 32768.0f; /* from 16-bit unsigned OE */
+        else for(; i; src--,i--) *dest-- = ((int)(Uint16)SWAPEND(*src)-32768) / 32768.0f; /* from 16-bit unsigned OE */
       }
       else /* from 16-bit same endianness */
       { if(SIGNED(cvt->srcFormat)) /* from 16-bit signed SE */
@@ -289,7 +318,7 @@ static void IntegerToFloat(GLM_AudioCVT *cvt)
       if(OPPEND(cvt->srcFormat)) /* from 16-bit opposite endianness */
       { Uint16 *src = (Uint16*)(cvt->buf+cvt->len/2-2);
         if(SIGNED(cvt->srcFormat)) for(; i; src--,i--) *dest-- = (Sint16)SWAPEND(*src) / 32768.0; /* from 16-bit signed OE */
-        else for(; i; src--,i--) *dest-- = ((Sint16)SWAPEND(*src)-32768) / 32768.0; /* from 16-bit unsigned OE */
+        else for(; i; src--,i--) *dest-- = ((int)(Uint16)SWAPEND(*src)-32768) / 32768.0; /* from 16-bit unsigned OE */
       }
       else /* from 16-bit same endianness */
       { if(SIGNED(cvt->srcFormat)) /* from 16-bit signed SE */
@@ -319,12 +348,13 @@ static void FloatToInteger(GLM_AudioCVT *cvt)
         for(; i; i--) *dest++ = (Sint8)(*src++ * 127);
       }
       else /* to 8-bit unsigned */
-      { Uint8 *dest = (Uint8*)(cvt->buf+cvt->len/4-1);
+      { Uint8 *dest = (Uint8*)cvt->buf;
         for(; i; i--) *dest++ = (Uint8)(*src++ * 127)+128;
       }
     }
     else if(BITS(cvt->destFormat)==16) /* to 16-bit */
-    { i = cvt->len/=2;
+    { i = cvt->len/4;
+      cvt->len /= 2;
       if(OPPEND(cvt->destFormat)) /* opposite endianness */
       { Uint16 *dest = (Uint16*)cvt->buf;
         Uint16  dv;
@@ -361,12 +391,13 @@ static void FloatToInteger(GLM_AudioCVT *cvt)
         for(; i; i--) *dest++ = (Sint8)(*src++ * 127);
       }
       else /* to 8-bit unsigned */
-      { Uint8 *dest = (Uint8*)(cvt->buf+cvt->len/4-1);
+      { Uint8 *dest = (Uint8*)cvt->buf;
         for(; i; i--) *dest++ = (Uint8)(*src++ * 127)+128;
       }
     }
     else if(BITS(cvt->destFormat)==16) /* to 16-bit */
-    { i = cvt->len/=4;
+    { i = cvt->len/8;
+      cvt->len /= 4;
       if(OPPEND(cvt->destFormat)) /* opposite endianness */
       { Uint16 *dest = (Uint16*)cvt->buf;
         Uint16  dv;
@@ -415,196 +446,190 @@ static void FloatToFloat(GLM_AudioCVT *cvt)
   }
 }
 
+/* the rate conversion kernels, instantiated from RateKernels.h for each sample type and channel count */
+#define CALC        int
+#define LOAD(p)     (*(p))
+#define STORE(p, v) (*(p) = (SAMPLE)(v))
+#define KERNEL S8
+#define SAMPLE Sint8
+#define CHANS 1
+#include "RateKernels.h"
+#define CHANS 2
+#include "RateKernels.h"
+#undef SAMPLE
+#undef KERNEL
+#define KERNEL U8
+#define SAMPLE Uint8
+#define CHANS 1
+#include "RateKernels.h"
+#define CHANS 2
+#include "RateKernels.h"
+#undef SAMPLE
+#undef KERNEL
+#define KERNEL S16
+#define SAMPLE Sint16
+#define CHANS 1
+#include "RateKernels.h"
+#define CHANS 2
+#include "RateKernels.h"
+#undef SAMPLE
+#undef KERNEL
+#define KERNEL U16
+#define SAMPLE Uint16
+#define CHANS 1
+#include "RateKernels.h"
+#define CHANS 2
+#include "RateKernels.h"
+#undef SAMPLE
+#undef KERNEL
+#undef LOAD
+#undef STORE
+
+/* 16-bit samples in the opposite byte order are swapped as they're loaded and stored */
+#define SAMPLE      Uint16
+#define STORE(p, v) (*(p) = (Uint16)SWAPEND((Uint16)(v)))
+#define KERNEL S16OE
+#define LOAD(p)     ((Sint16)(Uint16)SWAPEND(*(p)))
+#define CHANS 1
+#include "RateKernels.h"
+#define CHANS 2
+#include "RateKernels.h"
+#undef LOAD
+#undef KERNEL
+#define KERNEL U16OE
+#define LOAD(p)     ((Uint16)SWAPEND(*(p)))
+#define CHANS 1
+#include "RateKernels.h"
+#define CHANS 2
+#include "RateKernels.h"
+#undef LOAD
+#undef KERNEL
+#undef STORE
+#undef SAMPLE
+#undef CALC
+
+#define LOAD(p)     (*(p))
+#define STORE(p, v) (*(p) = (v))
+#define KERNEL F32
+#define SAMPLE float
+#define CALC   float
+#define CHANS 1
+#include "RateKernels.h"
+#define CHANS 2
+#include "RateKernels.h"
+#undef CALC
+#undef SAMPLE
+#undef KERNEL
+#define KERNEL F64
+#define SAMPLE double
+#define CALC   double
+#define CHANS 1
+#include "RateKernels.h"
+#define CHANS 2
+#include "RateKernels.h"
+#undef CALC
+#undef SAMPLE
+#undef KERNEL
+#undef LOAD
+#undef STORE
+
+typedef struct
+{ void (*halve[2])(Uint8 *buf, Uint32 frames);
+  void (*convert[2])(const Uint8 *src, Uint8 *dest, Uint32 srcFrames, Uint32 destFrames, int sinc, int sid);
+  int  limit; /* the largest divisor that can't overflow the integer arithmetic, or 0 for floating point */
+} RateKernels;
+
+#define RATE_KERNELS(k, limit) { { HalveRate1_##k, HalveRate2_##k }, { ConvertRate1_##k, ConvertRate2_##k }, limit }
+static const RateKernels rateKernels[] =
+{ RATE_KERNELS(S8, 8388608), RATE_KERNELS(U8, 8388608), RATE_KERNELS(S16, 32768), RATE_KERNELS(U16, 32768),
+  RATE_KERNELS(S16OE, 32768), RATE_KERNELS(U16OE, 32768), RATE_KERNELS(F32, 0), RATE_KERNELS(F64, 0)
+};
+#undef RATE_KERNELS
+
+/* returns the index of a format in the kernel tables: S8, U8, S16, U16, S16OE, U16OE, F32, F64 */
+static int KernelIndex(Uint16 format)
+{ if(FLOAT(format)) return BITS(format)==32 ? 6 : 7;
+  if(BITS(format)==8) return SIGNED(format) ? 0 : 1;
+  return (SIGNED(format) ? 2 : 3) + (OPPEND(format) ? 2 : 0);
+}
+
+static const RateKernels* GetRateKernels(Uint16 format) { return rateKernels + KernelIndex(format); }
+
 static void ConvertRate(GLM_AudioCVT *cvt, int destLen)
-{ int i, srate=cvt->srcRate, drate=cvt->destRate;
-  if(cvt->len<=BYTES(cvt->srcFormat)) return; /* no conversion if <=1 sample */
-
-  if(drate*2==srate) /* halving the rate */
-  { 
-    #define HALVE for(; i; src+=2,i--) *dest++ = (src[0]+src[1])/2;
-    if(BITS(cvt->srcFormat)==16) /* 16bit */
-    { i = destLen/2;
-      if(SIGNED(cvt->srcFormat)) /* 16bit signed */
-      { Sint16 *src = (Sint16*)cvt->buf, *dest = src;
-        HALVE
-      }
-      else /* 16bit unsigned */
-      { Uint16 *src = (Uint16*)cvt->buf, *dest = src;
-        HALVE
-      }
-    }
-    else if(BITS(cvt->srcFormat)==8) /* 8bit */
-    { i = destLen;
-      if(SIGNED(cvt->srcFormat)) /* 8bit signed */
-      { Sint8 *src = (Sint8*)cvt->buf, *dest = src;
-        HALVE
-      }
-      else /* 8bit unsigned */
-      { Uint8 *src = cvt->buf, *dest = src;
-        HALVE
-      }
-    }
-    else if(BITS(cvt->srcFormat)==32) /* 32bit */
-    { i = destLen/4;
-      if(FLOAT(cvt->srcFormat))
-      { float *src = (float*)cvt->buf, *dest = src;
-        HALVE
-      }
-    }
-    else if(BITS(cvt->srcFormat)==64) /* 64bit */
-    { i = destLen/8;
-      if(FLOAT(cvt->srcFormat))
-      { double *src = (double*)cvt->buf, *dest = src;
-        HALVE
-      }
-    }
-    #undef HALVE
+{ const RateKernels *k = GetRateKernels(cvt->srcFormat);
+  Uint32 frameSize = BYTES(cvt->srcFormat)*cvt->srcChans, srcFrames = cvt->len/frameSize;
+  Uint32 destFrames = destLen/frameSize;
+  int    chans = cvt->srcChans-1;
+  if(srcFrames<=1 || chans<0 || chans>1) return; /* no conversion if <=1 frame */
+
+  if(cvt->destRate*2==cvt->srcRate) /* halving the rate */
+  { k->halve[chans](cvt->buf, destFrames);
     cvt->len/=2;
   }
-  else /* any rate, length must be >1 sample. */ /* TODO: add the ability to select fast or high quality */
-  { 
-#define SE(s) SWAPEND((Uint16)s)
-#define CVTRATE_SE                            \
-  { s0=dest[0]=src[0], s1=src[1], diff=s1-s0; \
-    for(; i<dlen; i++)                        \
-    { sic += sinc;                            \
-      if(sic>sid)                             \
-      { do si++, sic-=sid; while(sic>=sid);   \
-        s0=src[si-1], s1=(si>=slen?s0:src[si]), diff=s1-s0; \
-      }                                       \
-      dest[i] = s0+diff*sic/sid;              \
-    }                                         \
-  }
-#define CVTRATE_OE                          \
-  { dest[0]=src[0], s0=SE(src[0]), s1=SE(src[1]), diff=s1-s0; \
-    for(; i<dlen; i++)                      \
-    { sic += sinc;                          \
-      if(sic>sid)                           \
-      { do si++, sic-=sid; while(sic>=sid); \
-        s0=SE(src[si-1]), s1=(si>=slen?s0:SE(src[si])), diff=s1-s0; \
-      }                                     \
-      t = s0+diff*sic/sid;                  \
-      dest[i] = SE(t);                      \
-    }                                       \
-  }
-#define CVTRATE2_SE                            \
-  { s0=dest[0]=src[0], s1=dest[1]=src[1], s2=src[2], s3=src[3], diff=s2-s0, diff2=s3-s1; \
-    for(; i<dlen; i+=2)                        \
-    { sic += sinc;                             \
-      if(sic>sid)                              \
-      { do si+=2, sic-=sid; while(sic>=sid);   \
-        s0=src[si-2], s2=(si>=slen?s0:src[si]),   diff=s2-s0; \
-        s1=src[si-1], s3=(si>=slen?s1:src[si+1]), diff=s3-s1; \
-      }                                        \
-      dest[i] = s0+diff*sic/sid;               \
-      dest[i+1] = s1+diff2*sic/sid;            \
-    }                                          \
-  }
-#define CVTRATE2_OE                            \
-  { dest[0]=src[0], s0=SE(src[0]), dest[1]=src[1], s1=SE(src[1]), s2=SE(src[2]), s3=SE(src[3]), diff=s2-s0, diff2=s3-s1; \
-    for(; i<dlen; i+=2)                        \
-    { sic += sinc;                             \
-      if(sic>sid)                              \
-      { do si+=2, sic-=sid; while(sic>=sid);   \
-        s0=SE(src[si-2]), s2=(si>=slen?s0:SE(src[si])),   diff=s2-s0; \
-        s1=SE(src[si-1]), s3=(si>=slen?s1:SE(src[si+1])), diff=s3-s1; \
-      }                                        \
-      t = s1+diff2*sic/sid;                    \
-      dest[i] = SE(t);                         \
-      t = s0+diff*sic/sid;                     \
-      dest[i+1] = SE(t);                       \
-    }                                          \
-  }
-
-    int sic=0, sid, sinc, si, slen=cvt->len, dlen=destLen;
-    void *dbuf = srate>drate ? cvt->buf : destLen>MAXALLOCA ? malloc(destLen) : alloca(destLen);
-    cvt->len = dlen;
-    i = si = cvt->srcChans;
-
-    if(FLOAT(cvt->srcFormat))
-    { if(BITS(cvt->srcFormat)==32) /* 32-bit floating point */
-      { float s0, s1, diff, s2, s3, diff2, *src=(float*)cvt->buf, *dest=(float*)dbuf;
-        slen/=4, dlen/=4;
-        sinc=slen, sid=dlen;
-
-        CVTRATE2_SE
-      }
-      else if(BITS(cvt->srcFormat)==64) /* 64-bit floating point */
-      { double s0, s1, diff, s2, s3, diff2, *src=(double*)cvt->buf, *dest=(double*)dbuf;
-        slen/=8, dlen/=8;
-        sinc=slen, sid=dlen;
-
-        CVTRATE2_SE
-      }
-    }
-    else
-    { int s0, s1, diff, s2, s3, diff2, t;
-      if(BITS(cvt->srcFormat)==16) /* 16bit */
-      { slen/=2, dlen/=2;
-        sinc=slen, sid=dlen; while(sid>32768) { sid>>=1, sinc>>=1; } /* prevent integer overflow */
-        if(cvt->srcChans==2)
-        { if(SIGNED(cvt->srcFormat))
-          { Sint16 *src = (Sint16*)cvt->buf, *dest=(Sint16*)dbuf;
-            if(OPPEND(cvt->srcFormat)) CVTRATE2_OE /* 16bit signed OE */
-            else CVTRATE2_SE /* 16 bit signed SE */
-          }
-          else
-          { Uint16 *src = (Uint16*)cvt->buf, *dest=(Uint16*)dbuf;
-            if(OPPEND(cvt->srcFormat)) CVTRATE2_OE /* 16bit unsigned OE */
-            else CVTRATE2_SE
-          }
-        }
-        else
-        { if(SIGNED(cvt->srcFormat))
-          { Sint16 *src = (Sint16*)cvt->buf, *dest=(Sint16*)dbuf;
-            if(OPPEND(cvt->srcFormat)) CVTRATE_OE /* 16bit signed OE */
-            else CVTRATE_SE /* 16 bit signed SE */
-          }
-          else
-          { Uint16 *src = (Uint16*)cvt->buf, *dest=(Uint16*)dbuf;
-            if(OPPEND(cvt->srcFormat)) CVTRATE_OE /* 16bit unsigned OE */
-            else CVTRATE_SE
-          }
-        }
-      }
-      else if(BITS(cvt->srcFormat)==8) /* 8bit */
-      { sinc=slen, sid=dlen; while(sid>8388608) { sid>>=1, sinc>>=1; } /* prevent integer overflow */
-        if(cvt->srcChans==2)
-        { if(SIGNED(cvt->srcFormat))
-          { Sint8 *src = (Sint8*)cvt->buf, *dest = (Sint8*)dbuf;
-            CVTRATE2_SE
-          }
-          else
-          { Uint8 *src = cvt->buf, *dest = (Uint8*)dbuf;
-            CVTRATE2_SE
-          }
-        }
-        else
-        { if(SIGNED(cvt->srcFormat))
-          { Sint8 *src = (Sint8*)cvt->buf, *dest = (Sint8*)dbuf;
-            CVTRATE_SE
-          }
-          else
-          { Uint8 *src = cvt->buf, *dest = (Uint8*)dbuf;
-            CVTRATE_SE
-          }
-        }
-      }
-    }
-
+  else /* any rate, by linear interpolation */
+  { void *dbuf = cvt->srcRate>cvt->destRate ? cvt->buf : destLen>MAXALLOCA ? malloc(destLen) : alloca(destLen);
+    int  sinc = srcFrames, sid = destFrames;
+    if(k->limit) while(sid>k->limit) { sid>>=1, sinc>>=1; } /* prevent integer overflow */
+    k->convert[chans](cvt->buf, (Uint8*)dbuf, srcFrames, destFrames, sinc, sid);
+    cvt->len = destLen;
     if(dbuf!=cvt->buf)
     { memcpy(cvt->buf, dbuf, destLen);
       if(destLen>MAXALLOCA) free(dbuf);
     }
-
-    #undef SE
-    #undef CVTRATE_SE
-    #undef CVTRATE_OE
-    #undef CVTRATE2_SE
-    #undef CVTRATE2_OE
   }
 }
 
+/* the mixing kernels, instantiated from MixKernels.h for each integer sample type */
+#define KERNEL S8
+#define SAMPLE Sint8
+#define LOAD(p) (*(p))
+#include "MixKernels.h"
+#undef LOAD
+#undef SAMPLE
+#undef KERNEL
+#define KERNEL U8
+#define SAMPLE Uint8
+#define LOAD(p) (*(p)-128)
+#include "MixKernels.h"
+#undef LOAD
+#undef SAMPLE
+#undef KERNEL
+#define KERNEL S16
+#define SAMPLE Sint16
+#define LOAD(p) (*(p))
+#include "MixKernels.h"
+#undef LOAD
+#undef SAMPLE
+#undef KERNEL
+#define KERNEL U16
+#define SAMPLE Uint16
+#define LOAD(p) (*(p)-32768)
+#include "MixKernels.h"
+#undef LOAD
+#undef KERNEL
+#define KERNEL S16OE
+#define LOAD(p) ((Sint16)(Uint16)SWAPEND(*(p)))
+#include "MixKernels.h"
+#undef LOAD
+#undef KERNEL
+#define KERNEL U16OE
+#define LOAD(p) ((int)(Uint16)SWAPEND(*(p))-32768)
+#include "MixKernels.h"
+#undef LOAD
+#undef SAMPLE
+#undef KERNEL
+
+typedef struct
+{ void (*mono)(Sint32 *dest, const void *data, Uint32 samples, int vol);
+  void (*stereo)(Sint32 *dest, const void *data, Uint32 samples, int left, int right);
+} MixKernels;
+
+#define MIX_KERNELS(k) { MixMono_##k, MixStereo_##k }
+static const MixKernels mixKernels[] =
+{ MIX_KERNELS(S8), MIX_KERNELS(U8), MIX_KERNELS(S16), MIX_KERNELS(U16), MIX_KERNELS(S16OE), MIX_KERNELS(U16OE)
+};
+#undef MIX_KERNELS
+
 static void ConvertMixMono(Sint32 *dest, void* data, Uint32 samples, Uint16 srcFormat, int vol)
 { if(FLOAT(srcFormat))
   { GLM_AudioCVT cvt;
@@ -630,46 +655,7 @@ static void ConvertMixMono(Sint32 *dest, void* data, Uint32 samples, Uint16 srcF
     ConvertMixMono(dest, cvt.buf, samples, cvt.destFormat, vol);
     if(len>MAXALLOCA) free(cvt.buf);
   }
-  else
-  { register Uint32 i=0;
-    if(BITS(srcFormat)==8) /* 8bit */
-    { if(SIGNED(srcFormat))  /* 8bit signed */
-      { Sint8 *src = (Sint8*)data;
-        if(vol>=256) for(; i<samples; i++) dest[i]+=src[i];
-        else for(; i<samples; i++) dest[i]+=(src[i]*vol)>>8;
-      }
-      else /* 8bit unsigned */
-      { Uint8 *src = (Uint8*)data;
-        if(vol>=256) for(; i<samples; i++) dest[i]+=src[i]-128;
-        else for(; i<samples; i++) dest[i]+=((Sint8)(src[i]-128)*vol)>>8;
-      }
-    }
-    else /* 16bit */
-    { if(OPPEND(srcFormat)) /* opposite endianness */
-      { Uint16 *src = (Uint16*)data;
-        if(SIGNED(srcFormat)) /* 16bit signed OE */
-        { if(vol>=256) for(; i<samples; i++) dest[i]+=(Sint16)SWAPEND(src[i]);
-          else for(; i<samples; i++) dest[i]+=((Sint16)SWAPEND(src[i])*vol)>>8;
-        }
-        else /* 16bit unsigned OE */
-        { if(vol>=256) for(; i<samples; i++) dest[i]+=(Sint16)SWAPEND(src[i])-32768;
-          else for(; i<samples; i++) dest[i]+=(((Sint16)SWAPEND(src[i])-32768)*vol)>>8;
-        }
-      }
-      else /* same endianness */
-      { if(SIGNED(srcFormat)) /* 16bit signed SE */
-        { Sint16 *src = (Sint16*)data;
-          if(vol>=256) for(; i<samples; i++) dest[i]+=src[i];
-          else for(; i<samples; i++) dest[i]+=(src[i]*vol)>>8;
-        }
-        else /* 16bit unsigned SE */
-        { Uint16 *src = (Uint16*)data;
-          if(vol>=256) for(; i<samples; i++) dest[i]+=src[i]-32768;
-          else for(; i<samples; i++) dest[i]+=((Sint16)(src[i]-32768)*vol)>>8;
-        }
-      }
-    }
-  }
+  else mixKernels[KernelIndex(srcFormat)].mono(dest, data, samples, vol);
 }
 
 static void ConvertMixStereo(Sint32 *dest, void* data, Uint32 samples, Uint16 srcFormat, int left, int right)
@@ -686,73 +672,27 @@ static void ConvertMixStereo(Sint32 *dest, void* data, Uint32 samples, Uint16 sr
     ConvertMixStereo(dest, cvt.buf, samples, cvt.destFormat, left, right);
     if(len>MAXALLOCA) free(cvt.buf);
   }
-  else
-  { register Uint32 i=0;
-    if(BITS(srcFormat)==8) /* 8bit */
-    { if(SIGNED(srcFormat))  /* 8bit signed */
-      { Sint8 *src = (Sint8*)data;
-        if(left>=256 && right>=256) for(; i<samples; i++) dest[i]+=src[i];
-        else
-          for(; i<samples; )
-          { dest[i]+=(src[i]*left)>>8;  i++;
-            dest[i]+=(src[i]*right)>>8; i++;
-          }
-      }
-      else /* 8bit unsigned */
-      { Uint8 *src = (Uint8*)data;
-        if(left>=256 && right>=256) for(; i<samples; i++) dest[i]+=src[i]-128;
-        else
-          for(; i<samples;)
-          { dest[i]+=((Sint8)(src[i]-128)*left )>>8; i++;
-            dest[i]+=((Sint8)(src[i]-128)*right)>>8; i++;
-          }
-      }
-    }
-    else /* 16bit */
-    { if(OPPEND(srcFormat)) /* opposite endianness */
-      { Uint16 *src = (Uint16*)data;
-        if(SIGNED(srcFormat)) /* 16bit signed OE */
-        { if(left>=256 && right>=256) for(; i<samples; i++) dest[i]+=(Sint16)SWAPEND(src[i]);
-          else for(; i<samples;)
-          { dest[i]+=((Sint16)SWAPEND(src[i])*left )>>8; i++;
-            dest[i]+=((Sint16)SWAPEND(src[i])*right)>>8; i++;
-          }
-        }
-        else /* 16bit unsigned OE */
-        { if(left>=256 && right>=256) for(; i<samples; i++) dest[i]+=(Sint16)SWAPEND(src[i])-32768;
-          else for(; i<samples;)
-          { dest[i]+=(((Sint16)SWAPEND(src[i])-32768)*left )>>8; i++;
-            dest[i]+=(((Sint16)SWAPEND(src[i])-32768)*right)>>8; i++;
-          }
-        }
-      }
-      else /* same endianness */
-      { if(SIGNED(srcFormat)) /* 16bit signed SE */
-        { Sint16 *src = (Sint16*)data;
-          if(left>=256 && right>=256) for(; i<samples; i++) dest[i]+=src[i];
-          else for(; i<samples;)
-          { dest[i]+=(src[i]*left )>>8; i++;
-            dest[i]+=(src[i]*right)>>8; i++;
-          }
-        }
-        else /* 16bit unsigned SE */
-        { Uint16 *src = (Uint16*)data;
-          if(left>=256 && right>=256) for(; i<samples; i++) dest[i]+=src[i]-32768;
-          else for(; i<samples;)
-          { dest[i]+=((Sint16)(src[i]-32768)*left )>>8; i++;
-            dest[i]+=((Sint16)(src[i]-32768)*right)>>8; i++;
-          }
-        }
-      }
-    }
-  }
+  else mixKernels[KernelIndex(srcFormat)].stereo(dest, data, samples, left, right);
 }
 
 int GLM_Init(Uint32 freq, Uint16 format, Uint8 channels, Uint32 bufferMs, MixCallback callback, void *context)
+{ return GLM_InitEx(freq, format, channels, bufferMs, callback, context, GLM_BACKEND_SDL, NULL);
+}
+
+int GLM_InitEx(Uint32 freq, Uint16 format, Uint8 channels, Uint32 bufferMs, MixCallback callback, void *context,
+               int output, const char *arg)
 { SDL_AudioSpec spec;
+  const GLM_Backend *be;
   int samples = freq*bufferMs/1000;
   if(initCount>0) { initCount++; return 0; }
-  
+
+  switch(output)
+  { case GLM_BACKEND_SDL:  be=&GLM_sdlBackend; break;
+    case GLM_BACKEND_NULL: be=&GLM_nullBackend; break;
+    case GLM_BACKEND_WAVE: be=&GLM_waveBackend; break;
+    default: SDL_SetError("Unknown output backend"); return -1;
+  }
+
   spec.freq     = freq;
   spec.format   = format;
   spec.channels = channels;
@@ -761,8 +701,10 @@ int GLM_Init(Uint32 freq, Uint16 format, Uint8 channels, Uint32 bufferMs, MixCal
   spec.userdata = context;
 
   mixCallback = callback;
-  SDL_PauseAudio(1);
-  if(SDL_OpenAudio(&spec, &mixFormat)<0) return -1;
+  audioPolicy = 0; /* the backend may run the callback on a new thread */
+  if(be->open(&spec, &mixFormat, arg)<0) return -1;
+  be->pause(1);
+  backend    = be;
   mixAccSize = mixFormat.samples*mixFormat.channels;
   mixAcc = malloc(sizeof(Sint32)*mixAccSize);
 
@@ -785,16 +727,33 @@ int GLM_GetFormat(Uint32 *freq, Uint16 *format, Uint8 *channels, Uint32 *bufferB
 void GLM_Quit()
 { if(initCount==0) return;
   if(--initCount==0)
-  { SDL_LockAudio();
-    SDL_PauseAudio(1);
-    SDL_UnlockAudio();
-    SDL_CloseAudio();
+  { backend->lock();
+    backend->pause(1);
+    backend->unlock();
+    backend->close();
+    GLM_StopRecording();
+    GLM_StopExport();
     free(mixAcc);
     mixCallback=NULL;
     mixAcc=NULL;
+    backend=NULL;
+    GLM_freeBuses();
+    GLM_AllocateVoices(0);
   }
 }
 
+void GLM_PauseAudio(int pause)
+{ if(initCount) backend->pause(pause);
+}
+
+void GLM_LockAudio()
+{ if(initCount) backend->lock();
+}
+
+void GLM_UnlockAudio()
+{ if(initCount) backend->unlock();
+}
+
 Uint16 GLM_GetMixVolume()
 { return (Uint16)mixVolume;
 }
@@ -803,6 +762,52 @@ void GLM_SetMixVolume(Uint16 volume)
 { mixVolume = volume>256 ? 256 : volume;
 }
 
+Uint16 GLM_GetLoadBudget()
+{ return (Uint16)loadBudget;
+}
+
+/* sets the portion of the buffer period, in thousandths, that mixing may take before the mixer starts to degrade. zero
+   disables degradation
+*/
+void GLM_SetLoadBudget(Uint16 permille)
+{ loadBudget = permille;
+  if(!permille) loadStats.level=0;
+}
+
+int GLM_GetLoadLevel()
+{ return loadStats.level;
+}
+
+void GLM_SetLodThresholds(Uint16 reduced, Uint16 low, Uint16 minimal, Sint32 priorityWeight)
+{ lodThresholds[0]=reduced, lodThresholds[1]=low, lodThresholds[2]=minimal;
+  lodWeight=priorityWeight;
+}
+
+/* picks a GLM_LOD_* tier for a voice from its effective volumes (0-256) and priority, lowering the tier under load */
+int GLM_SelectLod(Uint16 leftVolume, Uint16 rightVolume, Sint32 priority)
+{ Sint32 score = (leftVolume>rightVolume ? leftVolume : rightVolume) + priority*lodWeight;
+  int lod = score>=lodThresholds[0] ? GLM_LOD_FULL : score>=lodThresholds[1] ? GLM_LOD_REDUCED :
+            score>=lodThresholds[2] ? GLM_LOD_LOW : GLM_LOD_MINIMAL;
+  if(lod<GLM_LOD_MINIMAL && loadStats.level>=GLM_LOAD_LOWQUALITY) lod++;
+  if(lod<GLM_LOD_MINIMAL && loadStats.level>=GLM_LOAD_FEWERVOICES) lod++;
+  return lod;
+}
+
+int GLM_GetLoadStats(GLM_LoadStats *stats)
+{ if(!stats)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  *stats = loadStats;
+  return 0;
+}
+
+void GLM_ResetLoadStats()
+{ Uint16 load=loadStats.load, level=loadStats.level;
+  memset(&loadStats, 0, sizeof(loadStats));
+  loadStats.load=load, loadStats.level=level;
+}
+
 /* convert the accumulator format into some other format, performing clipping */
 int GLM_ConvertAcc(void *dest, Sint32 *src, Uint32 samples, Uint16 destFormat)
 { Uint32 i=0;
@@ -841,7 +846,10 @@ int GLM_ConvertAcc(void *dest, Sint32 *src, Uint32 samples, Uint16 destFormat)
     { Uint16 *dbuf = (Uint16*)dest;
       Sint32  tv;
       if(SIGNED(destFormat)) /* 16bit signed OE */
-        for(; i<samples; i++) dbuf[i] = SWAPEND(sbuf[i]);
+        for(; i<samples; i++)
+        { tv = (Uint16)sbuf[i];
+          dbuf[i] = (Uint16)SWAPEND(tv);
+        }
       else /* 16bit unsigned OE */
         for(; i<samples; i++)
         { tv = sbuf[i]+32768;
@@ -930,6 +938,378 @@ int GLM_Convert(GLM_AudioCVT *cvt)
   return 0;
 }
 
+/* streaming conversion. the converter decodes incoming chunks into floating point frames (downmixing if necessary),
+   keeps the frames still needed for interpolation, and encodes the resampled output into the destination format.
+   incomplete source frames are held until the rest of the frame arrives.
+*/
+#define CVT_CHUNK 256
+#define FIXED_ONE ((Uint64)1<<32)
+
+struct GLM_StreamConverter
+{ float  *frames;            /* pending input frames, interleaved with 'workChans' channels */
+  Uint64 pos, step;          /* resampler position relative to frames[0] and step per output frame, in 32.32 fixed point */
+  Uint32 nframes, capacity;  /* number of pending frames and size of the frame buffer, in frames */
+  Sint32 srcRate, destRate;
+  Uint16 srcFormat, destFormat;
+  Uint8  srcChans, destChans, workChans, partialLen;
+  Uint8  partial[16];        /* the bytes of an incomplete source frame */
+  Uint8  quality;
+};
+
+#define STREAMCOPY(cvt) ((cvt)->step==FIXED_ONE && !(Uint32)(cvt)->pos)
+/* the number of frames past the current one that the interpolator reads */
+#define LOOKAHEAD(cvt) (STREAMCOPY(cvt) ? 0 : (cvt)->quality==GLM_QUALITY_HIGH ? 2 : 1)
+
+static int ValidStreamFormat(Uint16 format, Uint8 chans)
+{ if(chans<1 || chans>2) return 0;
+  if(FLOAT(format)) return BITS(format)==32 || BITS(format)==64;
+  return BITS(format)==8 || BITS(format)==16;
+}
+
+static void DecodeSamples(float *dest, const void *data, Uint32 samples, Uint16 format)
+{ register Uint32 i=0;
+  if(FLOAT(format))
+  { if(BITS(format)==32)
+    { const float *src = (const float*)data;
+      for(; i<samples; i++) dest[i] = src[i]>1 ? 1 : src[i]<-1 ? -1 : src[i];
+    }
+    else
+    { const double *src = (const double*)data;
+      for(; i<samples; i++) dest[i] = src[i]>1 ? 1 : src[i]<-1 ? -1 : (float)src[i];
+    }
+  }
+  else if(BITS(format)==8) /* 8bit */
+  { if(SIGNED(format))
+    { const Sint8 *src = (const Sint8*)data;
+      for(; i<samples; i++) dest[i] = src[i] * (1.0f/128);
+    }
+    else
+    { const Uint8 *src = (const Uint8*)data;
+      for(; i<samples; i++) dest[i] = (src[i]-128) * (1.0f/128);
+    }
+  }
+  else /* 16bit */
+  { if(OPPEND(format)) /* opposite endianness */
+    { const Uint16 *src = (const Uint16*)data;
+      if(SIGNED(format)) for(; i<samples; i++) dest[i] = (Sint16)SWAPEND(src[i]) * (1.0f/32768);
+      else for(; i<samples; i++) dest[i] = ((int)(Uint16)SWAPEND(src[i])-32768) * (1.0f/32768);
+    }
+    else /* same endianness */
+    { if(SIGNED(format))
+      { const Sint16 *src = (const Sint16*)data;
+        for(; i<samples; i++) dest[i] = src[i] * (1.0f/32768);
+      }
+      else
+      { const Uint16 *src = (const Uint16*)data;
+        for(; i<samples; i++) dest[i] = (src[i]-32768) * (1.0f/32768);
+      }
+    }
+  }
+}
+
+static void EncodeSamples(void *data, const float *src, Uint32 samples, Uint16 format)
+{ register Uint32 i=0;
+  int v;
+  if(FLOAT(format))
+  { if(BITS(format)==32) memcpy(data, src, samples*sizeof(float));
+    else
+    { double *dest = (double*)data;
+      for(; i<samples; i++) dest[i] = src[i];
+    }
+  }
+  else if(BITS(format)==8) /* 8bit */
+  { Uint8 *dest = (Uint8*)data;
+    for(; i<samples; i++)
+    { v = (int)(src[i]*128);
+      if(v<-128) v=-128; else if(v>127) v=127;
+      dest[i] = (Uint8)(SIGNED(format) ? v : v+128);
+    }
+  }
+  else /* 16bit */
+  { Uint16 *dest = (Uint16*)data, dv;
+    for(; i<samples; i++)
+    { v = (int)(src[i]*32768);
+      if(v<-32768) v=-32768; else if(v>32767) v=32767;
+      dv = (Uint16)(SIGNED(format) ? v : v+32768);
+      dest[i] = OPPEND(format) ? (Uint16)SWAPEND(dv) : dv;
+    }
+  }
+}
+
+static int GrowStream(GLM_StreamConverter *cvt, Uint32 frames)
+{ if(frames>cvt->capacity)
+  { Uint32 capacity = cvt->capacity ? cvt->capacity : 1024;
+    float *buf;
+    while(capacity<frames) capacity*=2;
+    buf = (float*)realloc(cvt->frames, capacity*cvt->workChans*sizeof(float));
+    if(!buf)
+    { SDL_SetError("Out of memory");
+      return -1;
+    }
+    cvt->frames=buf, cvt->capacity=capacity;
+  }
+  return 0;
+}
+
+/* decodes whole source frames onto the end of the pending frames. the buffer must already be large enough */
+static void DecodeFrames(GLM_StreamConverter *cvt, const Uint8 *src, Uint32 frames)
+{ float *dest = cvt->frames + cvt->nframes*cvt->workChans;
+  cvt->nframes += frames;
+  if(cvt->srcChans==cvt->workChans) DecodeSamples(dest, src, frames*cvt->srcChans, cvt->srcFormat);
+  else /* stereo to mono */
+  { float tmp[CVT_CHUNK*2];
+    Uint32 i, n, fsize=BYTES(cvt->srcFormat)*2;
+    for(; frames; frames-=n, src+=n*fsize)
+    { n = frames<CVT_CHUNK ? frames : CVT_CHUNK;
+      DecodeSamples(tmp, src, n*2, cvt->srcFormat);
+      for(i=0; i<n; i++) *dest++ = (tmp[i*2]+tmp[i*2+1])*0.5f;
+    }
+  }
+}
+
+static int StreamAppend(GLM_StreamConverter *cvt, const Uint8 *src, Uint32 bytes)
+{ Uint32 fsize = cvt->srcChans*BYTES(cvt->srcFormat), frames;
+  if(cvt->partialLen)
+  { Uint32 need = fsize-cvt->partialLen;
+    if(bytes<need)
+    { memcpy(cvt->partial+cvt->partialLen, src, bytes);
+      cvt->partialLen += (Uint8)bytes;
+      return 0;
+    }
+    memcpy(cvt->partial+cvt->partialLen, src, need);
+    if(GrowStream(cvt, cvt->nframes+1)<0) return -1;
+    DecodeFrames(cvt, cvt->partial, 1);
+    src += need, bytes -= need, cvt->partialLen = 0;
+  }
+
+  frames = bytes/fsize;
+  if(frames)
+  { if(GrowStream(cvt, cvt->nframes+frames)<0) return -1;
+    DecodeFrames(cvt, src, frames);
+  }
+  cvt->partialLen = (Uint8)(bytes-frames*fsize);
+  memcpy(cvt->partial, src+frames*fsize, cvt->partialLen);
+  return 0;
+}
+
+/* produces up to 'max' frames of output in the working channel layout */
+static Uint32 StreamResample(GLM_StreamConverter *cvt, float *dest, Uint32 max)
+{ const float *src = cvt->frames;
+  Uint64 pos=cvt->pos, step=cvt->step;
+  Uint32 n=0, i, c, avail=cvt->nframes, chans=cvt->workChans;
+  float  frac, xm1, x0, x1, x2;
+
+  if(STREAMCOPY(cvt))
+  { i = (Uint32)(pos>>32);
+    n = avail>i ? avail-i : 0;
+    if(n>max) n=max;
+    memcpy(dest, src+i*cvt->workChans, n*cvt->workChans*sizeof(float));
+    cvt->pos += (Uint64)n<<32;
+    return n;
+  }
+
+  if(cvt->quality==GLM_QUALITY_LOW)
+    for(; n<max; n++,pos+=step)
+    { i = (Uint32)(pos>>32);
+      if(i+1>=avail) break;
+      if(chans==1) dest[n] = src[i];
+      else dest[n*2]=src[i*2], dest[n*2+1]=src[i*2+1];
+    }
+  else if(cvt->quality==GLM_QUALITY_NORMAL && chans==1)
+    for(; n<max; n++,pos+=step)
+    { i = (Uint32)(pos>>32);
+      if(i+1>=avail) break;
+      frac = (Uint32)pos * (1.0f/4294967296.0f);
+      dest[n] = src[i] + (src[i+1]-src[i])*frac;
+    }
+  else if(cvt->quality==GLM_QUALITY_NORMAL)
+    for(; n<max; n++,pos+=step)
+    { i = (Uint32)(pos>>32);
+      if(i+1>=avail) break;
+      frac = (Uint32)pos * (1.0f/4294967296.0f);
+      i *= 2;
+      dest[n*2]   = src[i]   + (src[i+2]-src[i])*frac;
+      dest[n*2+1] = src[i+1] + (src[i+3]-src[i+1])*frac;
+    }
+  else /* cubic (catmull-rom) interpolation. the frame before 'i' is kept by StreamEmit, except at the very start */
+    for(; n<max; n++,pos+=step)
+    { i = (Uint32)(pos>>32);
+      if(i+2>=avail) break;
+      frac = (Uint32)pos * (1.0f/4294967296.0f);
+      for(c=0; c<chans; c++)
+      { x0 = src[i*chans+c], x1 = src[(i+1)*chans+c], x2 = src[(i+2)*chans+c];
+        xm1 = i ? src[(i-1)*chans+c] : x0;
+        dest[n*chans+c] = x0 + 0.5f*frac*(x1-xm1 + frac*(2*xm1 - 5*x0 + 4*x1 - x2 + frac*(3*(x0-x1) + x2-xm1)));
+      }
+    }
+  cvt->pos = pos;
+  return n;
+}
+
+static Sint32 StreamEmit(GLM_StreamConverter *cvt, Uint8 *dest, Uint32 maxFrames)
+{ float  tmp[CVT_CHUNK*2];
+  Uint32 total=0, want, n, i, dsize=cvt->destChans*BYTES(cvt->destFormat);
+
+  while(total<maxFrames)
+  { want = maxFrames-total;
+    if(want>CVT_CHUNK) want=CVT_CHUNK;
+    n = StreamResample(cvt, tmp, want);
+    if(!n) break;
+    if(cvt->destChans>cvt->workChans) /* mono to stereo */
+      for(i=n; i--; ) tmp[i*2] = tmp[i*2+1] = tmp[i];
+    EncodeSamples(dest, tmp, n*cvt->destChans, cvt->destFormat);
+    dest += n*dsize, total += n;
+    if(n<want) break;
+  }
+
+  /* discard the frames that are no longer needed, keeping one behind the position for cubic interpolation */
+  n = (Uint32)(cvt->pos>>32);
+  if(n>cvt->nframes) n=cvt->nframes;
+  if(n && cvt->quality==GLM_QUALITY_HIGH && !STREAMCOPY(cvt)) n--;
+  if(n)
+  { cvt->nframes -= n;
+    memmove(cvt->frames, cvt->frames+n*cvt->workChans, cvt->nframes*cvt->workChans*sizeof(float));
+    cvt->pos -= (Uint64)n<<32;
+  }
+  return (Sint32)(total*dsize);
+}
+
+GLM_StreamConverter* GLM_CreateStreamConverter(Sint32 srcRate, Uint16 srcFormat, Uint8 srcChans,
+                                               Sint32 destRate, Uint16 destFormat, Uint8 destChans)
+{ GLM_StreamConverter *cvt;
+  if(!ValidStreamFormat(srcFormat, srcChans) || !ValidStreamFormat(destFormat, destChans))
+  { SDL_SetError("Unsupported audio format");
+    return NULL;
+  }
+  if(srcRate<=0 || destRate<=0)
+  { SDL_SetError("Invalid sampling rate");
+    return NULL;
+  }
+
+  cvt = (GLM_StreamConverter*)calloc(1, sizeof(GLM_StreamConverter));
+  if(!cvt)
+  { SDL_SetError("Out of memory");
+    return NULL;
+  }
+  cvt->srcFormat = srcFormat, cvt->srcChans  = srcChans;
+  cvt->destRate  = destRate,  cvt->destFormat = destFormat, cvt->destChans = destChans;
+  cvt->workChans = srcChans<destChans ? srcChans : destChans;
+  cvt->quality   = GLM_QUALITY_NORMAL;
+  GLM_SetStreamRate(cvt, srcRate);
+  return cvt;
+}
+
+void GLM_FreeStreamConverter(GLM_StreamConverter *cvt)
+{ if(cvt)
+  { free(cvt->frames);
+    free(cvt);
+  }
+}
+
+/* changes the source rate without disturbing the stream (eg, for pitch changes) */
+int GLM_SetStreamRate(GLM_StreamConverter *cvt, Sint32 srcRate)
+{ if(!cvt)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(srcRate<=0)
+  { SDL_SetError("Invalid sampling rate");
+    return -1;
+  }
+  cvt->srcRate = srcRate;
+  cvt->step    = ((Uint64)srcRate<<32) / (Uint32)cvt->destRate;
+  return 0;
+}
+
+int GLM_SetStreamQuality(GLM_StreamConverter *cvt, int quality)
+{ if(!cvt)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(quality<GLM_QUALITY_LOW || quality>GLM_QUALITY_HIGH)
+  { SDL_SetError("Invalid resampling quality");
+    return -1;
+  }
+  cvt->quality = (Uint8)quality;
+  return 0;
+}
+
+/* discards all pending data, eg, after seeking */
+int GLM_ResetStream(GLM_StreamConverter *cvt)
+{ if(!cvt)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  cvt->nframes=0, cvt->pos=0, cvt->partialLen=0;
+  return 0;
+}
+
+/* returns the number of source bytes that must be added to produce exactly 'destFrames' frames of output */
+Sint32 GLM_StreamInputSize(GLM_StreamConverter *cvt, Uint32 destFrames)
+{ Uint32 need, fsize;
+  if(!cvt)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(!destFrames) return 0;
+
+  need  = (Uint32)((cvt->pos + (Uint64)(destFrames-1)*cvt->step)>>32) + 1 + LOOKAHEAD(cvt);
+  fsize = cvt->srcChans*BYTES(cvt->srcFormat);
+  return need<=cvt->nframes ? 0 : (Sint32)((need-cvt->nframes)*fsize - cvt->partialLen);
+}
+
+/* returns the number of bytes of output that adding 'srcBytes' bytes of source data would produce */
+Sint32 GLM_StreamOutputSize(GLM_StreamConverter *cvt, Uint32 srcBytes)
+{ Uint64 end;
+  Uint32 avail, ahead;
+  if(!cvt)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+
+  avail = cvt->nframes + (cvt->partialLen+srcBytes)/(cvt->srcChans*BYTES(cvt->srcFormat));
+  ahead = LOOKAHEAD(cvt); /* interpolation needs the following frames */
+  if(avail<=ahead) return 0;
+  avail -= ahead;
+  end = (Uint64)avail<<32;
+  if(end<=cvt->pos) return 0;
+  return (Sint32)(((end-cvt->pos+cvt->step-1)/cvt->step) * cvt->destChans*BYTES(cvt->destFormat));
+}
+
+/* adds the source data to the stream and writes as much output as is available and fits into 'dest', returning the
+   number of bytes written. source data that can't be converted yet is retained for the next call.
+*/
+Sint32 GLM_StreamConvert(GLM_StreamConverter *cvt, const void *src, Uint32 srcBytes, void *dest, Uint32 destBytes)
+{ if(!cvt || (!src && srcBytes) || (!dest && destBytes))
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(srcBytes && StreamAppend(cvt, (const Uint8*)src, srcBytes)<0) return -1;
+  return StreamEmit(cvt, (Uint8*)dest, destBytes/(cvt->destChans*BYTES(cvt->destFormat)));
+}
+
+/* writes the remainder of the stream, holding the last frame for interpolation, and resets the converter. anything that
+   doesn't fit into 'dest' is discarded, along with any incomplete frame.
+*/
+Sint32 GLM_StreamFlush(GLM_StreamConverter *cvt, void *dest, Uint32 destBytes)
+{ Sint32 written;
+  Uint32 ahead;
+  if(!cvt || (!dest && destBytes))
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  ahead = LOOKAHEAD(cvt);
+  if(cvt->nframes && ahead)
+  { if(GrowStream(cvt, cvt->nframes+ahead)<0) return -1;
+    for(; ahead; ahead--,cvt->nframes++)
+      memcpy(cvt->frames+cvt->nframes*cvt->workChans, cvt->frames+(cvt->nframes-1)*cvt->workChans,
+             cvt->workChans*sizeof(float));
+  }
+  written = StreamEmit(cvt, (Uint8*)dest, destBytes/(cvt->destChans*BYTES(cvt->destFormat)));
+  GLM_ResetStream(cvt);
+  return written;
+}
+
 int GLM_Copy(Sint32 *dest, Sint32 *src, Uint32 samples)
 { if(!dest || !src)
   { SDL_SetError("NULL pointer passed");
@@ -975,6 +1355,7 @@ int GLM_Mix(Sint32 *dest, Sint32 *src, Uint32 samples, Uint16 leftVolume, Uint16
     return -1;
   }
   if(left==0 && right==0) return 0;
+  if(left>256 || right>256) return GLM_MixGain(dest, src, samples, left, right); /* amplifying needs 64-bit math */
   if(mixFormat.channels==1)
   { left = (left+right)>>1;
     if(left>=256) for(; i<samples; i++) dest[i]+=src[i];
@@ -999,6 +1380,197 @@ int GLM_Mix(Sint32 *dest, Sint32 *src, Uint32 samples, Uint16 leftVolume, Uint16
   return 0;
 }
 
+/* like GLM_Mix, but the gains (where 256 is unity) may be above unity, eg, to mix the data once for several voices
+   playing it in sync
+*/
+int GLM_MixGain(Sint32 *dest, Sint32 *src, Uint32 samples, Uint32 leftGain, Uint32 rightGain)
+{ Uint32 i;
+  Sint64 left=leftGain, right=rightGain;
+  if(!dest || !src)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(mixFormat.channels==1)
+  { left = (left+right)>>1;
+    for(i=0; i<samples; i++) dest[i] += (Sint32)((src[i]*left)>>8);
+  }
+  else
+    for(i=0; i<samples; i+=2)
+    { dest[i]   += (Sint32)((src[i]*left)>>8);
+      dest[i+1] += (Sint32)((src[i+1]*right)>>8);
+    }
+  return 0;
+}
+
+/* the channel matrix kernels, with the common shapes unrolled. m[d*srcChans+s] is the gain from source channel s to
+   destination channel d. the math is done in floating point, which compilers can vectorize, unlike 64-bit integers
+*/
+static void Matrix1To2(Sint32 *dest, const Sint32 *src, Uint32 frames, const float *m)
+{ float m0=m[0], m1=m[1];
+  Uint32 i;
+  for(i=0; i<frames; dest+=2,i++)
+  { dest[0] += (Sint32)(src[i]*m0);
+    dest[1] += (Sint32)(src[i]*m1);
+  }
+}
+
+static void Matrix2To1(Sint32 *dest, const Sint32 *src, Uint32 frames, const float *m)
+{ float m0=m[0], m1=m[1];
+  Uint32 i;
+  for(i=0; i<frames; src+=2,i++) dest[i] += (Sint32)(src[0]*m0 + src[1]*m1);
+}
+
+static void Matrix2To2(Sint32 *dest, const Sint32 *src, Uint32 frames, const float *m)
+{ float m0=m[0], m1=m[1], m2=m[2], m3=m[3];
+  Uint32 i;
+  for(i=0; i<frames; src+=2,dest+=2,i++)
+  { float l=(float)src[0], r=(float)src[1];
+    dest[0] += (Sint32)(l*m0 + r*m1);
+    dest[1] += (Sint32)(l*m2 + r*m3);
+  }
+}
+
+static void Matrix2To6(Sint32 *dest, const Sint32 *src, Uint32 frames, const float *m)
+{ Uint32 i;
+  float  g[12];
+  for(i=0; i<12; i++) g[i] = m[i]; /* copied, so the compiler knows the stores can't change them */
+  for(i=0; i<frames; src+=2,dest+=6,i++)
+  { float l=(float)src[0], r=(float)src[1];
+    dest[0] += (Sint32)(l*g[0]  + r*g[1]);
+    dest[1] += (Sint32)(l*g[2]  + r*g[3]);
+    dest[2] += (Sint32)(l*g[4]  + r*g[5]);
+    dest[3] += (Sint32)(l*g[6]  + r*g[7]);
+    dest[4] += (Sint32)(l*g[8]  + r*g[9]);
+    dest[5] += (Sint32)(l*g[10] + r*g[11]);
+  }
+}
+
+static void Matrix6To2(Sint32 *dest, const Sint32 *src, Uint32 frames, const float *m)
+{ float  g[12];
+  Uint32 i;
+  for(i=0; i<12; i++) g[i] = m[i];
+  for(i=0; i<frames; src+=6,dest+=2,i++)
+  { dest[0] += (Sint32)(src[0]*g[0] + src[1]*g[1] + src[2]*g[2] + src[3]*g[3] + src[4]*g[4]  + src[5]*g[5]);
+    dest[1] += (Sint32)(src[0]*g[6] + src[1]*g[7] + src[2]*g[8] + src[3]*g[9] + src[4]*g[10] + src[5]*g[11]);
+  }
+}
+
+static void Matrix8To2(Sint32 *dest, const Sint32 *src, Uint32 frames, const float *m)
+{ float  g[16];
+  Uint32 i;
+  for(i=0; i<16; i++) g[i] = m[i];
+  for(i=0; i<frames; src+=8,dest+=2,i++)
+  { dest[0] += (Sint32)(src[0]*g[0] + src[1]*g[1] + src[2]*g[2]  + src[3]*g[3]  + src[4]*g[4]  + src[5]*g[5]  +
+                        src[6]*g[6] + src[7]*g[7]);
+    dest[1] += (Sint32)(src[0]*g[8] + src[1]*g[9] + src[2]*g[10] + src[3]*g[11] + src[4]*g[12] + src[5]*g[13] +
+                        src[6]*g[14] + src[7]*g[15]);
+  }
+}
+
+static void MatrixAny(Sint32 *dest, Uint32 destChans, const Sint32 *src, Uint32 srcChans, Uint32 frames,
+                      const float *m)
+{ float  v;
+  Uint32 i, d, s;
+  for(i=0; i<frames; src+=srcChans,dest+=destChans,i++)
+    for(d=0; d<destChans; d++)
+    { for(s=0,v=0; s<srcChans; s++) v += src[s]*m[d*srcChans+s];
+      dest[d] += (Sint32)v;
+    }
+}
+
+static void MatrixFixed2To2(Sint32 *dest, const Sint32 *src, Uint32 frames, const Sint32 *m)
+{ Sint64 g0=m[0], g1=m[1], g2=m[2], g3=m[3];
+  Uint32 i;
+  for(i=0; i<frames; src+=2,dest+=2,i++)
+  { dest[0] += (Sint32)((src[0]*g0 + src[1]*g1)>>16);
+    dest[1] += (Sint32)((src[0]*g2 + src[1]*g3)>>16);
+  }
+}
+
+static void MatrixFixedAny(Sint32 *dest, Uint32 destChans, const Sint32 *src, Uint32 srcChans, Uint32 frames,
+                           const Sint32 *m)
+{ Sint64 v;
+  Uint32 i, d, s;
+  for(i=0; i<frames; src+=srcChans,dest+=destChans,i++)
+    for(d=0; d<destChans; d++)
+    { for(s=0,v=0; s<srcChans; s++) v += (Sint64)src[s]*m[d*srcChans+s];
+      dest[d] += (Sint32)(v>>16);
+    }
+}
+
+static int CheckMatrix(Sint32 *dest, Uint32 destChans, const Sint32 *src, Uint32 srcChans, const void *matrix)
+{ if(!dest || !src || !matrix)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(!destChans || !srcChans || destChans>GLM_MAX_CHANNELS || srcChans>GLM_MAX_CHANNELS)
+  { SDL_SetError("Unsupported number of channels.");
+    return -1;
+  }
+  return 0;
+}
+
+/* mixes 'frames' frames from 'src' into 'dest' through a channel matrix, for downmixing, upmixing, channel swapping,
+   stereo widening, mid/side processing, and so on. matrix[d*srcChans+s] is the gain from source channel s to
+   destination channel d. both streams may have up to GLM_MAX_CHANNELS channels, and they must not overlap
+*/
+int GLM_MatrixMix(Sint32 *dest, Uint32 destChans, const Sint32 *src, Uint32 srcChans, Uint32 frames,
+                  const float *matrix)
+{ if(CheckMatrix(dest, destChans, src, srcChans, matrix)<0) return -1;
+
+  if(srcChans==1 && destChans==2) Matrix1To2(dest, src, frames, matrix);
+  else if(srcChans==2 && destChans==1) Matrix2To1(dest, src, frames, matrix);
+  else if(srcChans==2 && destChans==2) Matrix2To2(dest, src, frames, matrix);
+  else if(srcChans==2 && destChans==6) Matrix2To6(dest, src, frames, matrix);
+  else if(srcChans==6 && destChans==2) Matrix6To2(dest, src, frames, matrix);
+  else if(srcChans==8 && destChans==2) Matrix8To2(dest, src, frames, matrix);
+  else MatrixAny(dest, destChans, src, srcChans, frames, matrix);
+  return 0;
+}
+
+/* like GLM_MatrixMix, but the gains are in 16.16 fixed point (so 65536 is unity), for callers whose gains are integer
+   volumes. the sums are kept in 64 bits, so the result is exact before the final shift
+*/
+int GLM_MatrixMixFixed(Sint32 *dest, Uint32 destChans, const Sint32 *src, Uint32 srcChans, Uint32 frames,
+                       const Sint32 *matrix)
+{ if(CheckMatrix(dest, destChans, src, srcChans, matrix)<0) return -1;
+  if(srcChans==2 && destChans==2) MatrixFixed2To2(dest, src, frames, matrix);
+  else MatrixFixedAny(dest, destChans, src, srcChans, frames, matrix);
+  return 0;
+}
+
+/* mixes mono data into the accumulator, panning it across the output channels. this lets distant stereo voices be
+   converted and mixed as mono
+*/
+int GLM_ConvertMixMono(Sint32 *dest, void *data, Uint32 frames, Uint16 srcFormat, Uint16 leftVolume, Uint16 rightVolume)
+{ Sint32 tmp[CVT_CHUNK];
+  Uint32 i, n, bytes=BYTES(srcFormat);
+  if(!dest || !data)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(mixFormat.channels==1)
+  { ConvertMixMono(dest, data, frames, srcFormat, ((int)leftVolume+(int)rightVolume)>>1);
+    return 0;
+  }
+  if(mixFormat.channels!=2)
+  { SDL_SetError("Unsupported number of channels.");
+    return -1;
+  }
+
+  for(; frames; frames-=n)
+  { n = frames>CVT_CHUNK ? CVT_CHUNK : frames;
+    memset(tmp, 0, n*sizeof(Sint32));
+    ConvertMixMono(tmp, data, n, srcFormat, 256);
+    if(leftVolume==256 && rightVolume==256)
+      for(i=0; i<n; dest+=2,i++) dest[0]+=tmp[i], dest[1]+=tmp[i];
+    else
+      for(i=0; i<n; dest+=2,i++) dest[0]+=(tmp[i]*leftVolume)>>8, dest[1]+=(tmp[i]*rightVolume)>>8;
+    data = (Uint8*)data + n*bytes;
+  }
+  return 0;
+}
+
 int GLM_ConvertMix(Sint32 *dest, void* data, Uint32 samples, Uint16 srcFormat,
                    Uint16 channels, Uint16 leftVolume, Uint16 rightVolume)
 { if(!dest || !data)
@@ -1014,6 +1586,138 @@ int GLM_ConvertMix(Sint32 *dest, void* data, Uint32 samples, Uint16 srcFormat,
   return 0;
 }
 
+/* mixes 'count' of a voice's frames starting at frame 'pos' of the buffer, with the gains moving linearly from the
+   initial gains at the start of the buffer to the targets at its end
+*/
+static void MixVoiceRun(const GLM_VoiceMix *v, Uint32 pos, Uint32 count)
+{ Sint32 tmp[CVT_CHUNK], *dest = v->dest + pos*mixFormat.channels;
+  Uint8  *src = (Uint8*)v->data + (v->position+pos)*BYTES(v->format)*v->channels;
+  Sint64 left, right, lstep, rstep;
+  Uint32 i, n;
+
+  /* constant gains that fit in the kernels' 16-bit volumes go straight through the conversion kernels. larger gains
+     (eg, the summed gains of many coalesced channels) take the ramp path below, which does its math in 64 bits
+  */
+  if(v->left==v->leftTarget && v->right==v->rightTarget && v->left<=65535 && v->right<=65535)
+  { if(v->channels==mixFormat.channels)
+      GLM_ConvertMix(dest, src, count*v->channels, v->format, v->channels, (Uint16)v->left, (Uint16)v->right);
+    else GLM_ConvertMixMono(dest, src, count, v->format, (Uint16)v->left, (Uint16)v->right);
+    return;
+  }
+
+  lstep = ((Sint64)v->leftTarget-v->left)*65536 / v->frames; /* the gains are in 16.16 fixed point */
+  rstep = ((Sint64)v->rightTarget-v->right)*65536 / v->frames;
+  left  = ((Sint64)v->left<<16) + lstep*pos;
+  right = ((Sint64)v->right<<16) + rstep*pos;
+  for(; count; count-=n)
+  { n = count>CVT_CHUNK/v->channels ? CVT_CHUNK/v->channels : count;
+    memset(tmp, 0, n*v->channels*sizeof(Sint32));
+    GLM_ConvertMix(tmp, src, n*v->channels, v->format, v->channels, 256, 256);
+    src += n*BYTES(v->format)*v->channels;
+    if(mixFormat.channels==1)
+      for(i=0; i<n; left+=lstep,right+=rstep,i++) dest[i] += (Sint32)((tmp[i]*((left+right)>>1))>>24);
+    else if(v->channels==1)
+      for(i=0; i<n; left+=lstep,right+=rstep,dest+=2,i++)
+      { dest[0] += (Sint32)((tmp[i]*left)>>24);
+        dest[1] += (Sint32)((tmp[i]*right)>>24);
+      }
+    else
+      for(i=0; i<n; left+=lstep,right+=rstep,dest+=2,i++)
+      { dest[0] += (Sint32)((tmp[i*2]*left)>>24);
+        dest[1] += (Sint32)((tmp[i*2+1]*right)>>24);
+      }
+    if(mixFormat.channels==1) dest += n;
+  }
+}
+
+/* mixes a batch of voices, each a run of frames from a sound in memory, into their streams. this lets a managed mixer
+   gather its voices and mix them with one call. runs of silent blocks are skipped if the voice has a silence map
+*/
+int GLM_MixBatch(const GLM_VoiceMix *voices, Uint32 count)
+{ Uint32 i, pos, next, block;
+  int    silent;
+  if(!voices && count)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  for(i=0; i<count; i++)
+  { const GLM_VoiceMix *v = voices+i;
+    if(!v->data || !v->dest)
+    { SDL_SetError("NULL pointer passed");
+      return -1;
+    }
+    if(v->channels!=1 && v->channels!=mixFormat.channels)
+    { SDL_SetError("Unsupported number of channels.");
+      return -1;
+    }
+    for(pos=0; pos<v->frames; pos=next)
+    { if(!v->silence)
+      { MixVoiceRun(v, 0, v->frames);
+        break;
+      }
+      block  = (v->position+pos)/GLM_SILENCE_BLOCK;
+      silent = v->silence[block>>3]>>(block&7) & 1;
+      next   = (block+1)*GLM_SILENCE_BLOCK - v->position;
+      for(block++; next<v->frames && (v->silence[block>>3]>>(block&7) & 1)==silent; block++)
+        next += GLM_SILENCE_BLOCK;
+      if(next>v->frames) next = v->frames;
+      if(!silent) MixVoiceRun(v, pos, next-pos);
+    }
+  }
+  return 0;
+}
+
+float GLM_readSample(const Uint8 *p, Uint16 format)
+{ if(FLOAT(format)) return (BITS(format)==32 ? *(const float*)p : (float)*(const double*)p) * 32768;
+  if(BITS(format)==8) return (float)(SIGNED(format) ? *(const Sint8*)p*256 : (*p-128)*256);
+  else
+  { Uint16 v = *(const Uint16*)p;
+    if(OPPEND(format)) v = (Uint16)SWAPEND(v);
+    return (float)(SIGNED(format) ? (Sint16)v : (int)v-32768);
+  }
+}
+
+/* returns the magnitude of a sample, on a 16-bit scale */
+static Uint32 SampleLevel(const Uint8 *p, Uint16 format)
+{ float v = GLM_readSample(p, format);
+  if(v<0) v=-v;
+  return v>=65536 ? 65536 : (Uint32)v;
+}
+
+/* builds a map of the blocks of GLM_SILENCE_BLOCK frames in which every sample is within 'threshold' of zero (on a
+   16-bit scale), with one bit per block, set if the block is silent. 'map' must hold a bit for each block, including
+   a final partial block. returns the number of frames up to the end of the last sample that isn't silent, after which
+   a sound playing once can be stopped early
+*/
+Sint32 GLM_BuildSilenceMap(const void *data, Uint32 frames, Uint16 format, Uint8 channels, Uint16 threshold,
+                           Uint8 *map)
+{ const Uint8 *p = (const Uint8*)data;
+  Uint32 sampleSize = BYTES(format), block, start, end, i, audible=0;
+
+  if(!data || !map)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(!channels || (FLOAT(format) ? BITS(format)!=32 && BITS(format)!=64 : BITS(format)!=8 && BITS(format)!=16))
+  { SDL_SetError("Unsupported format");
+    return -1;
+  }
+  if(frames>0x7FFFFFFF)
+  { SDL_SetError("Too many frames");
+    return -1;
+  }
+
+  memset(map, 0, (frames+GLM_SILENCE_BLOCK*8-1)/(GLM_SILENCE_BLOCK*8));
+  for(block=0,start=0; start<frames; start=end,block++)
+  { int silent=1;
+    end = start+GLM_SILENCE_BLOCK<frames ? start+GLM_SILENCE_BLOCK : frames;
+    for(i=start*channels; i<end*channels; p+=sampleSize,i++)
+      if(SampleLevel(p, format)>threshold) silent=0, audible=i/channels+1;
+    if(silent) map[block>>3] |= (Uint8)(1<<(block&7));
+  }
+  return (Sint32)audible;
+}
+
 int GLM_DivideAccumulator(Sint32 divisor)
 { int i=0, len=mixAccSize;
   if(divisor<2) return 0;
@@ -36,27 +36,297 @@ typedef struct
   Uint8  srcChans,  destChans;
 } GLM_AudioCVT;
 
+typedef struct GLM_StreamConverter GLM_StreamConverter;
+typedef struct GLM_MappedFile GLM_MappedFile;
+typedef struct GLM_Noise GLM_Noise;
+
+#define GLM_MAX_STEMS    15 /* the most bus stems that GLM_StartExport can publish */
+#define GLM_MAX_CHANNELS 8  /* the most channels that GLM_MatrixMix can handle */
+
+typedef struct
+{ const Uint8 *data;  /* the sample data within the mapping */
+  Uint32      bytes;  /* the size of the sample data, in whole frames */
+  Uint32      freq;
+  Uint16      format;
+  Uint8       channels;
+} GLM_MapInfo;
+
+typedef struct
+{ Uint32 buffers, overruns, degraded; /* buffers mixed, buffers that missed the deadline, and buffers mixed degraded */
+  Uint32 lastCost, peakCost;          /* the time taken to mix the last buffer and the longest buffer, in microseconds */
+  Uint16 load;                        /* the smoothed mixing time, in thousandths of the buffer period */
+  Uint16 level;                       /* the current GLM_LOAD_* degradation level */
+} GLM_LoadStats;
+
+typedef struct
+{ Sint32 policy;   /* a GLM_SCHED_* value */
+  Sint32 priority; /* the realtime priority (1-99) for FIFO and RR, or the nice value (-20 to 19) for NORMAL */
+  Uint64 affinity; /* a mask of the CPUs the thread may run on, or 0 to leave it unchanged */
+} GLM_ThreadPolicy;
+
+typedef struct
+{ Uint16 flags;      /* the GLM_VOICE_* actions requested by group commands for this buffer */
+  Uint16 volume;     /* the product of the volumes of the voice's groups, from 0-256 */
+  Uint32 fadeMs;     /* the fade time for GLM_VOICE_FADEOUT */
+  float  rate;       /* the automated playback rate multiplier for this buffer, or 1 */
+  Uint32 automation; /* a mask with bit (1<<GLM_PARAM_*) set for each automated parameter, and GLM_ADSR_ACTIVE */
+} GLM_VoiceControl;
+
+typedef struct
+{ Uint32 time;  /* the time of the point in milliseconds, from when the envelope was submitted */
+  float  value;
+  Sint32 curve; /* the GLM_CURVE_* shape of the segment leading up to this point */
+} GLM_Breakpoint;
+
+typedef struct
+{ Uint32 attackMs, decayMs;
+  float  sustain; /* the level held after the decay until note-off, from 0 to 1 */
+  Uint32 releaseMs;
+  Sint32 attackCurve, decayCurve, releaseCurve; /* the GLM_CURVE_* shape of each segment */
+} GLM_Adsr;
+
+typedef struct
+{ const void *data;     /* the sound to analyze */
+  Uint32 frames, freq;
+  Uint16 format;
+  Uint8  channels;
+  float  loudness;      /* set to the integrated loudness, in LUFS */
+  float  truePeak;      /* set to the true peak, in dBTP */
+  float  gain;          /* set to the linear gain that normalizes the sound */
+} GLM_LoudnessJob;
+
+typedef struct
+{ Uint64 framesWritten;
+  Uint32 framesDropped; /* frames lost because the writer fell behind */
+  Uint32 overflows;     /* the number of buffers dropped */
+  Sint32 recording;     /* true if a recording is in progress */
+  Sint32 failed;        /* true if the file couldn't be written */
+} GLM_RecordStats;
+
+/* the header of the shared memory published by GLM_StartExport. it's followed by 'streams' rings, 'streamBytes'
+   apart, starting 'headerSize' bytes from the start of the mapping. the first ring holds the output and the rest hold
+   the bus stems, all in the output format. frame n of the audio is at index n%frames in each ring. the writer never
+   waits for readers, so to read, a reader should
+   1. wait for 'magic' to be GLM_EXPORT_MAGIC and check 'version',
+   2. read 'writeFrame' and copy the frames before it that it hasn't read yet (at most 'frames' of them),
+   3. read 'writeFrame' again, and discard any copied frame older than writeFrame-frames+bufferFrames, since the
+      writer may have been overwriting it during the copy.
+   'writeTime' is the time of the last write, from a system-wide monotonic clock in microseconds (CLOCK_MONOTONIC or
+   QueryPerformanceCounter). it and 'writeFrame' are consistent if 'sequence' was even and unchanged while they were
+   read. 'magic' is cleared when the export stops.
+*/
+typedef struct
+{ Uint32 magic, version;
+  Uint32 headerSize;            /* the offset of the first ring from the start of the mapping */
+  Uint32 freq;
+  Uint16 format;                /* the AUDIO_* format of all the streams */
+  Uint8  channels;
+  Uint8  streams;               /* the number of rings: the output, followed by the stems */
+  Uint32 frames;                /* the size of each ring in frames, a power of two */
+  Uint32 streamBytes;           /* the distance between rings */
+  Uint32 bufferFrames;          /* the largest number of frames written at once */
+  volatile Uint32 writeFrame;   /* the number of frames written so far, wrapping at 2^32 */
+  volatile Uint32 sequence;     /* incremented before and after 'writeFrame' and 'writeTime' are changed */
+  volatile Uint64 writeTime;
+  Uint32 stemBuses[GLM_MAX_STEMS]; /* the bus whose output is in each stem */
+} GLM_ExportHeader;
+
+typedef struct
+{ const void  *data;    /* the sound, in memory */
+  Sint32      *dest;    /* the stream to mix into, the output or a bus buffer */
+  const Uint8 *silence; /* the sound's silence map from GLM_BuildSilenceMap, or NULL */
+  Uint32 position;      /* the frame of the sound to start at */
+  Uint32 frames;
+  Uint16 format;
+  Uint8  channels;      /* 1, or the mixer's number of channels */
+  Uint8  reserved;
+  Uint32 left, right;   /* the gains at the start of the buffer, where 256 is full volume */
+  Uint32 leftTarget, rightTarget; /* the gains at the end of the buffer. the gains are ramped between them */
+} GLM_VoiceMix;
+
 typedef void (SDLCALL *MixCallback)(Sint32 *stream, Uint32 frames, void *context);
 
+/* degradation levels, from GLM_GetLoadLevel. each level implies the ones before it */
+#define GLM_LOAD_NORMAL      0
+#define GLM_LOAD_NOEFFECTS   1 /* optional effects should be skipped */
+#define GLM_LOAD_LOWQUALITY  2 /* resampling should use GLM_QUALITY_LOW */
+#define GLM_LOAD_FEWERVOICES 3 /* the lowest-priority quarter of the voices should be virtualized */
+#define GLM_LOAD_CRITICAL    4 /* the lowest-priority half of the voices should be virtualized */
+
+/* resampling quality for GLM_SetStreamQuality */
+#define GLM_QUALITY_LOW    0 /* nearest neighbor */
+#define GLM_QUALITY_NORMAL 1 /* linear interpolation */
+#define GLM_QUALITY_HIGH   2 /* cubic interpolation */
+
+/* per-voice level of detail, from GLM_SelectLod */
+#define GLM_LOD_FULL    0 /* cubic interpolation, all filters */
+#define GLM_LOD_REDUCED 1 /* linear interpolation, all filters */
+#define GLM_LOD_LOW     2 /* linear interpolation, filters bypassed */
+#define GLM_LOD_MINIMAL 3 /* nearest neighbor, filters bypassed, mixed as mono */
+
+/* thread types and scheduling policies for GLM_SetThreadPolicy */
+#define GLM_THREAD_AUDIO  0 /* the thread that runs the mix callback */
+#define GLM_THREAD_WORKER 1 /* the offline background threads (analysis, prefetch, recording). never realtime */
+#define GLM_SCHED_NORMAL  0 /* the default time-sharing scheduler, with a nice value */
+#define GLM_SCHED_FIFO    1 /* realtime first-in, first-out. falls back to NORMAL with the highest priority */
+#define GLM_SCHED_RR      2 /* realtime round-robin. falls back like GLM_SCHED_FIFO */
+
+/* commands for GLM_PostGroupCommand and GLM_PostVoiceCommand, and the resulting voice control flags */
+#define GLM_GROUP_PAUSE   0
+#define GLM_GROUP_RESUME  1
+#define GLM_GROUP_STOP    2
+#define GLM_GROUP_FADEOUT 3 /* the argument is the fade time in milliseconds */
+#define GLM_GROUP_VOLUME  4 /* the argument is the group volume, from 0-256 */
+#define GLM_GROUP_NOTEON  5 /* restarts the ADSR envelope's attack */
+#define GLM_GROUP_NOTEOFF 6 /* starts the ADSR envelope's release. the voice is stopped when the release ends */
+#define GLM_VOICE_PAUSE   1
+#define GLM_VOICE_RESUME  2
+#define GLM_VOICE_STOP    4
+#define GLM_VOICE_FADEOUT 8
+
+/* automatable parameters, and the shapes of automation segments */
+#define GLM_PARAM_VOLUME    0  /* a gain from 0 to 1 */
+#define GLM_PARAM_PAN       1  /* from -1 (left) to 1 (right) */
+#define GLM_PARAM_RATE      2  /* a playback rate multiplier, from 0 to 16 */
+#define GLM_CURVE_LINEAR    0
+#define GLM_CURVE_EXP       1  /* exponential, for even-sounding volume and pitch sweeps. both ends must be positive */
+#define GLM_MAX_BREAKPOINTS 16
+#define GLM_ADSR_ACTIVE     0x100 /* in GLM_VoiceControl.automation, set when the voice has an ADSR envelope */
+
+/* noise colors for GLM_CreateNoise */
+#define GLM_NOISE_WHITE 0
+#define GLM_NOISE_PINK  1 /* -3dB per octave */
+#define GLM_NOISE_BROWN 2 /* -6dB per octave */
+
+/* the number of frames covered by each bit of a silence map from GLM_BuildSilenceMap */
+#define GLM_SILENCE_BLOCK 256
+
+/* shared memory export, from GLM_StartExport */
+#define GLM_EXPORT_MAGIC   0x584D4C47 /* "GLMX" in little-endian */
+#define GLM_EXPORT_VERSION 1
+
+/* output backends for GLM_InitEx */
+#define GLM_BACKEND_SDL  0 /* the SDL audio device */
+#define GLM_BACKEND_NULL 1 /* discards the output, but calls the callback in real time */
+#define GLM_BACKEND_WAVE 2 /* writes the output to the WAV file named by the 'arg' parameter, in real time */
+
 extern DECLSPEC int  SDLCALL GLM_Init(Uint32 freq, Uint16 format, Uint8 channels, Uint32 bufferMs,
                                       MixCallback callback, void *context);
+extern DECLSPEC int  SDLCALL GLM_InitEx(Uint32 freq, Uint16 format, Uint8 channels, Uint32 bufferMs,
+                                        MixCallback callback, void *context, int backend, const char *arg);
 extern DECLSPEC int  SDLCALL GLM_GetFormat(Uint32 *freq, Uint16 *format, Uint8 *channels, Uint32 *bufferBytes);
 extern DECLSPEC void SDLCALL GLM_Quit();
 
+extern DECLSPEC void SDLCALL GLM_PauseAudio(int pause);
+extern DECLSPEC void SDLCALL GLM_LockAudio();
+extern DECLSPEC void SDLCALL GLM_UnlockAudio();
+
 extern DECLSPEC Uint16 SDLCALL GLM_GetMixVolume();
 extern DECLSPEC void   SDLCALL GLM_SetMixVolume(Uint16 volume);
 
+extern DECLSPEC Uint16 SDLCALL GLM_GetLoadBudget();
+extern DECLSPEC void   SDLCALL GLM_SetLoadBudget(Uint16 permille);
+extern DECLSPEC int    SDLCALL GLM_GetLoadLevel();
+extern DECLSPEC int    SDLCALL GLM_GetLoadStats(GLM_LoadStats *stats);
+extern DECLSPEC void   SDLCALL GLM_ResetLoadStats();
+
+extern DECLSPEC int SDLCALL GLM_SetThreadPolicy(int thread, const GLM_ThreadPolicy *policy);
+extern DECLSPEC int SDLCALL GLM_GetThreadPolicy(int thread, GLM_ThreadPolicy *requested, GLM_ThreadPolicy *effective);
+extern DECLSPEC int SDLCALL GLM_UpdateThreadPolicy(int thread, Uint32 *applied);
+
+extern DECLSPEC int SDLCALL GLM_AllocateVoices(Uint32 count);
+extern DECLSPEC int SDLCALL GLM_ResetVoice(Uint32 voice);
+extern DECLSPEC int SDLCALL GLM_SetVoiceFilter(Uint32 handle, Uint32 lowPass, Uint32 highPass);
+extern DECLSPEC int SDLCALL GLM_FilterVoice(Uint32 voice, Sint32 *buffer, Uint32 frames);
+extern DECLSPEC int SDLCALL GLM_SetVoiceGroups(Uint32 voice, Uint32 groups);
+extern DECLSPEC int SDLCALL GLM_PostGroupCommand(Uint32 groups, int command, Sint32 arg);
+extern DECLSPEC GLM_VoiceControl* SDLCALL GLM_GetVoiceControls();
+extern DECLSPEC Uint32 SDLCALL GLM_AcquireVoice(Uint32 voice);
+extern DECLSPEC int    SDLCALL GLM_ReleaseVoice(Uint32 voice);
+extern DECLSPEC int    SDLCALL GLM_VoiceFromHandle(Uint32 handle);
+extern DECLSPEC int    SDLCALL GLM_PostVoiceCommand(Uint32 handle, int command, Sint32 arg);
+extern DECLSPEC int    SDLCALL GLM_SetVoiceAutomation(Uint32 handle, int param, const GLM_Breakpoint *points,
+                                                      Uint32 count);
+extern DECLSPEC int    SDLCALL GLM_SetVoiceAdsr(Uint32 handle, const GLM_Adsr *adsr);
+extern DECLSPEC int    SDLCALL GLM_AutomateVoice(Uint32 voice, Sint32 *buffer, Uint32 offset, Uint32 frames);
+
+extern DECLSPEC int     SDLCALL GLM_AllocateBuses(Uint32 count);
+extern DECLSPEC Sint32* SDLCALL GLM_GetBusBuffer(Uint32 bus);
+extern DECLSPEC int     SDLCALL GLM_GetBusFrames(Uint32 bus);
+extern DECLSPEC int     SDLCALL GLM_SetBusRate(Uint32 bus, Uint32 freq);
+extern DECLSPEC int     SDLCALL GLM_GetBusRate(Uint32 bus);
+extern DECLSPEC int     SDLCALL GLM_SetBusVolume(Uint32 bus, Uint16 volume);
+extern DECLSPEC int     SDLCALL GLM_SetBusDucking(Uint32 bus, Uint32 sidechain, Uint16 threshold, Uint16 depth,
+                                                  Uint32 attackMs, Uint32 releaseMs);
+extern DECLSPEC int     SDLCALL GLM_GetBusGain(Uint32 bus);
+extern DECLSPEC int     SDLCALL GLM_SetBusAutomation(Uint32 bus, const GLM_Breakpoint *points, Uint32 count);
+extern DECLSPEC int     SDLCALL GLM_MixBuses(Sint32 *dest, Uint32 frames);
+
+extern DECLSPEC void SDLCALL GLM_SetLodThresholds(Uint16 reduced, Uint16 low, Uint16 minimal, Sint32 priorityWeight);
+extern DECLSPEC int  SDLCALL GLM_SelectLod(Uint16 leftVolume, Uint16 rightVolume, Sint32 priority);
+
 extern DECLSPEC int SDLCALL GLM_ConvertAcc(void *dest, Sint32 *src, Uint32 samples, Uint16 destFormat);
 extern DECLSPEC int SDLCALL GLM_SetupCVT(GLM_AudioCVT *cvt);
 extern DECLSPEC int SDLCALL GLM_Convert(GLM_AudioCVT *cvt);
 
+extern DECLSPEC GLM_StreamConverter* SDLCALL GLM_CreateStreamConverter(Sint32 srcRate, Uint16 srcFormat, Uint8 srcChans,
+                                                                      Sint32 destRate, Uint16 destFormat, Uint8 destChans);
+extern DECLSPEC void   SDLCALL GLM_FreeStreamConverter(GLM_StreamConverter *cvt);
+extern DECLSPEC int    SDLCALL GLM_SetStreamRate(GLM_StreamConverter *cvt, Sint32 srcRate);
+extern DECLSPEC int    SDLCALL GLM_SetStreamQuality(GLM_StreamConverter *cvt, int quality);
+extern DECLSPEC int    SDLCALL GLM_ResetStream(GLM_StreamConverter *cvt);
+extern DECLSPEC Sint32 SDLCALL GLM_StreamInputSize(GLM_StreamConverter *cvt, Uint32 destFrames);
+extern DECLSPEC Sint32 SDLCALL GLM_StreamOutputSize(GLM_StreamConverter *cvt, Uint32 srcBytes);
+extern DECLSPEC Sint32 SDLCALL GLM_StreamConvert(GLM_StreamConverter *cvt, const void *src, Uint32 srcBytes,
+                                                 void *dest, Uint32 destBytes);
+extern DECLSPEC Sint32 SDLCALL GLM_StreamFlush(GLM_StreamConverter *cvt, void *dest, Uint32 destBytes);
+
+extern DECLSPEC GLM_MappedFile* SDLCALL GLM_MapWave(const char *path, GLM_MapInfo *info);
+extern DECLSPEC GLM_MappedFile* SDLCALL GLM_MapRaw(const char *path, Uint32 offset, Uint32 length, GLM_MapInfo *info);
+extern DECLSPEC void SDLCALL GLM_UnmapFile(GLM_MappedFile *file);
+extern DECLSPEC int  SDLCALL GLM_AdviseMapping(GLM_MappedFile *file, const void *data, Uint32 bytes);
+
+extern DECLSPEC GLM_Noise* SDLCALL GLM_CreateNoise(int type, Uint32 seed);
+extern DECLSPEC void SDLCALL GLM_FreeNoise(GLM_Noise *noise);
+extern DECLSPEC int  SDLCALL GLM_SetNoiseFilter(GLM_Noise *noise, Uint32 lowPass, Uint32 highPass);
+extern DECLSPEC int  SDLCALL GLM_MixNoise(GLM_Noise *noise, Sint32 *dest, Uint32 frames, Uint16 leftVolume,
+                                          Uint16 rightVolume);
+
+extern DECLSPEC int SDLCALL GLM_AnalyzeLoudness(GLM_LoudnessJob *jobs, Uint32 count, float target, float ceiling,
+                                                Uint32 threads);
+
+extern DECLSPEC int SDLCALL GLM_StartRecording(const char *path, Uint16 format);
+extern DECLSPEC int SDLCALL GLM_StopRecording();
+extern DECLSPEC int SDLCALL GLM_GetRecordingStats(GLM_RecordStats *stats);
+
+extern DECLSPEC int SDLCALL GLM_StartExport(const char *name, Uint32 bufferMs, const Uint32 *stems, Uint32 stemCount);
+extern DECLSPEC int SDLCALL GLM_StopExport();
+
+extern DECLSPEC int SDLCALL GLM_SetCacheDirectory(const char *directory, Uint64 maxBytes);
+extern DECLSPEC int SDLCALL GLM_HashFile(const char *path, Uint64 *hash);
+extern DECLSPEC int SDLCALL GLM_CacheLookup(Uint64 hash, Uint32 freq, Uint16 format, Uint8 channels, char *path,
+                                            Uint32 pathSize);
+extern DECLSPEC int SDLCALL GLM_CacheStore(Uint64 hash, Uint32 freq, Uint16 format, Uint8 channels, const void *data,
+                                           Uint32 bytes);
+
 extern DECLSPEC int SDLCALL GLM_Copy(Sint32 *dest, Sint32 *src, Uint32 samples);
 extern DECLSPEC int SDLCALL GLM_VolumeScale(Sint32 *stream, Uint32 samples, Uint16 leftVolume, Uint16 rightVolume);
 extern DECLSPEC int SDLCALL GLM_Mix(Sint32 *dest, Sint32 *src, Uint32 samples, Uint16 leftVolume, Uint16 rightVolume);
+extern DECLSPEC int SDLCALL GLM_MixGain(Sint32 *dest, Sint32 *src, Uint32 samples, Uint32 leftGain, Uint32 rightGain);
 extern DECLSPEC int SDLCALL GLM_ConvertMix(Sint32 *dest, void *src, Uint32 samples, Uint16 srcFormat,
                                            Uint16 channels, Uint16 leftVolume, Uint16 rightVolume);
+extern DECLSPEC int SDLCALL GLM_ConvertMixMono(Sint32 *dest, void *src, Uint32 frames, Uint16 srcFormat,
+                                               Uint16 leftVolume, Uint16 rightVolume);
+extern DECLSPEC int SDLCALL GLM_MatrixMix(Sint32 *dest, Uint32 destChans, const Sint32 *src, Uint32 srcChans,
+                                          Uint32 frames, const float *matrix);
+extern DECLSPEC int SDLCALL GLM_MatrixMixFixed(Sint32 *dest, Uint32 destChans, const Sint32 *src, Uint32 srcChans,
+                                               Uint32 frames, const Sint32 *matrix);
+extern DECLSPEC int SDLCALL GLM_MixBatch(const GLM_VoiceMix *voices, Uint32 count);
 extern DECLSPEC int SDLCALL GLM_DivideAccumulator(Sint32 divisor);
 
+extern DECLSPEC Sint32 SDLCALL GLM_BuildSilenceMap(const void *data, Uint32 frames, Uint16 format, Uint8 channels,
+                                                   Uint16 threshold, Uint8 *map);
+
 #ifdef __cplusplus
 }
 #endif
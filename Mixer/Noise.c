@@ -0,0 +1,155 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* noise generators, which are mixed straight into the accumulator rather than being looped from samples. white noise
+   comes from LANES independent xorshift generators stepped side by side, so that the compiler can vectorize the inner
+   loop. pink noise is white noise through Paul Kellet's three-pole approximation of a -3dB/octave slope, and brown noise
+   is white noise through a leaky integrator. the result can be colored further with one-pole low- and high-pass filters.
+*/
+
+#include "Internal.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LANES 4   /* the number of white noise generators run side by side */
+#define BLOCK 256 /* the number of frames generated at a time. must be a multiple of LANES */
+
+struct GLM_Noise
+{ Uint32 state[LANES];     /* the xorshift states, which must be nonzero */
+  float  pink[3], brown;   /* the coloring filter states */
+  float  lp, hp;           /* the low- and high-pass filter states */
+  float  lpCoef, hpCoef;   /* the one-pole filter coefficients, where zero disables the filter */
+  float  scale;            /* the full scale of the accumulator, which depends on the output format */
+  Uint32 freq;
+  Uint8  type, channels;
+};
+
+static float CutoffToCoef(Uint32 cutoff, Uint32 freq)
+{ if(!cutoff || cutoff>=freq/2) return 0;
+  return (float)(1-exp(-2*3.14159265358979*cutoff/freq));
+}
+
+/* fills 'out' with 'frames' white noise samples from -1 to 1. 'frames' must be a multiple of LANES */
+static void White(GLM_Noise *noise, float *out, Uint32 frames)
+{ Uint32 s[LANES], i, j;
+  memcpy(s, noise->state, sizeof(s));
+  for(i=0; i<frames; i+=LANES) /* each step is a separate loop over the lanes so that they map onto vector ops */
+  { for(j=0; j<LANES; j++) s[j] ^= s[j]<<13;
+    for(j=0; j<LANES; j++) s[j] ^= s[j]>>17;
+    for(j=0; j<LANES; j++) s[j] ^= s[j]<<5;
+    for(j=0; j<LANES; j++) out[i+j] = (float)(Sint32)s[j] * (1.0f/2147483648.0f);
+  }
+  memcpy(noise->state, s, sizeof(s));
+}
+
+/* creates a GLM_NOISE_* noise generator for the current output format. the seed can be anything */
+GLM_Noise* GLM_CreateNoise(int type, Uint32 seed)
+{ GLM_Noise *noise;
+  Uint16 format;
+  Uint32 freq, i;
+  Uint8  channels;
+
+  if(type<GLM_NOISE_WHITE || type>GLM_NOISE_BROWN)
+  { SDL_SetError("Invalid noise type");
+    return NULL;
+  }
+  if(GLM_GetFormat(&freq, &format, &channels, NULL)<0) return NULL;
+  noise = (GLM_Noise*)calloc(1, sizeof(GLM_Noise));
+  if(!noise)
+  { SDL_SetError("Out of memory");
+    return NULL;
+  }
+  for(i=0; i<LANES; i++) /* give each lane a distinct nonzero state */
+  { seed = seed*1664525 + 1013904223;
+    noise->state[i] = seed ? seed : 0x9E3779B9;
+  }
+  noise->type = (Uint8)type, noise->freq = freq, noise->channels = channels;
+  noise->scale = BITS(format)==8 ? 127.0f : 32767.0f;
+  return noise;
+}
+
+void GLM_FreeNoise(GLM_Noise *noise)
+{ free(noise);
+}
+
+/* sets the cutoff frequencies of the generator's low-pass and high-pass filters, in Hz. zero disables a filter */
+int GLM_SetNoiseFilter(GLM_Noise *noise, Uint32 lowPass, Uint32 highPass)
+{ if(!noise)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  noise->lpCoef = CutoffToCoef(lowPass, noise->freq);
+  noise->hpCoef = CutoffToCoef(highPass, noise->freq);
+  return 0;
+}
+
+/* generates 'frames' frames of noise and adds them to the accumulator, scaled by the given volumes (where 256 is
+   unity, and higher values amplify). with more than two output channels, the noise goes into the front left and right
+   channels
+*/
+int GLM_MixNoise(GLM_Noise *noise, Sint32 *dest, Uint32 frames, Uint16 leftVolume, Uint16 rightVolume)
+{ float  block[BLOCK], p0, p1, p2, brown, lp, hp, lpCoef, hpCoef, scale;
+  Sint32 left=leftVolume, right=rightVolume, s;
+  Uint32 count, i, chans;
+
+  if(!noise || !dest)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(noise->channels==1) left = (left+right)>>1;
+  p0 = noise->pink[0], p1 = noise->pink[1], p2 = noise->pink[2];
+  brown = noise->brown, lp = noise->lp, hp = noise->hp, lpCoef = noise->lpCoef, hpCoef = noise->hpCoef;
+  scale = noise->scale, chans = noise->channels;
+
+  for(; frames; frames-=count)
+  { count = frames<BLOCK ? frames : BLOCK;
+    White(noise, block, (count+LANES-1)/LANES*LANES); /* the extra samples at the end are simply dropped */
+
+    if(noise->type==GLM_NOISE_PINK)
+      for(i=0; i<count; i++)
+      { float w = block[i];
+        p0 = 0.99765f*p0 + w*0.0990460f;
+        p1 = 0.96300f*p1 + w*0.2965164f;
+        p2 = 0.57000f*p2 + w*1.0526913f;
+        block[i] = (p0 + p1 + p2 + w*0.1848f) * 0.125f;
+      }
+    else if(noise->type==GLM_NOISE_BROWN)
+      for(i=0; i<count; i++) brown = (brown + 0.02f*block[i]) * (1/1.02f), block[i] = brown*3.5f;
+
+    if(lpCoef!=0) for(i=0; i<count; i++) lp += lpCoef*(block[i]-lp), block[i] = lp;
+    if(hpCoef!=0) for(i=0; i<count; i++) hp += hpCoef*(block[i]-hp), block[i] -= hp;
+
+    if(chans==1)
+      for(i=0; i<count; i++) dest[i] += ((Sint32)(block[i]*scale)*left)>>8;
+    else
+      for(i=0; i<count; i++)
+      { s = (Sint32)(block[i]*scale);
+        dest[i*chans]   += (s*left)>>8;
+        dest[i*chans+1] += (s*right)>>8;
+      }
+    dest += count*chans;
+  }
+
+  /* flush denormals out of the decaying states so that silence stays cheap */
+  if(fabs(brown)<1e-20f) brown=0;
+  if(fabs(lp)<1e-20f) lp=0;
+  if(fabs(hp)<1e-20f) hp=0;
+  noise->pink[0] = p0, noise->pink[1] = p1, noise->pink[2] = p2;
+  noise->brown = brown, noise->lp = lp, noise->hp = hp;
+  return 0;
+}
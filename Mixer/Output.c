@@ -0,0 +1,205 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* output backends. the SDL backend simply forwards to SDL's audio functions. the null and wave file backends run the
+   callback on their own thread, paced to real time, so that mixing can be exercised without any audio hardware.
+*/
+
+#include "Internal.h"
+#include "SDL_thread.h"
+#include "SDL_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+Uint64 GLM_microseconds()
+{
+#ifdef WIN32
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER count;
+  Uint64 c, f;
+  if(!freq.QuadPart) QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  c = (Uint64)count.QuadPart, f = (Uint64)freq.QuadPart;
+  return c/f*1000000 + c%f*1000000/f; /* split so that c*1000000 can't overflow after days of uptime */
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (Uint64)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+#endif
+}
+
+/* SDL backend */
+static int SDLOpen(SDL_AudioSpec *desired, SDL_AudioSpec *obtained, const char *arg)
+{ (void)arg;
+  return SDL_OpenAudio(desired, obtained);
+}
+
+static void SDLClose()          { SDL_CloseAudio(); }
+static void SDLPause(int pause) { SDL_PauseAudio(pause); }
+static void SDLLock()           { SDL_LockAudio(); }
+static void SDLUnlock()         { SDL_UnlockAudio(); }
+
+const GLM_Backend GLM_sdlBackend = { SDLOpen, SDLClose, SDLPause, SDLLock, SDLUnlock };
+
+/* null and wave file backends */
+static struct
+{ SDL_AudioSpec spec;
+  SDL_Thread   *thread;
+  SDL_mutex    *lock;
+  Uint8        *buffer;
+  FILE         *file;
+  Uint32        dataBytes;
+  volatile int  paused, quit;
+} sink;
+
+static void WriteLE(Uint8 *buf, Uint32 value, int bytes)
+{ for(; bytes; value>>=8,bytes--) *buf++ = (Uint8)value;
+}
+
+void GLM_writeWaveHeader(Uint8 header[44], Uint32 freq, Uint16 format, Uint8 channels, Uint32 dataBytes)
+{ Uint32 frameSize = channels*BYTES(format);
+  memcpy(header, "RIFF", 4);
+  WriteLE(header+4, 36+dataBytes, 4);
+  memcpy(header+8, "WAVEfmt ", 8);
+  WriteLE(header+16, 16, 4);                  /* format chunk size */
+  WriteLE(header+20, 1, 2);                   /* PCM */
+  WriteLE(header+22, channels, 2);
+  WriteLE(header+24, freq, 4);
+  WriteLE(header+28, freq*frameSize, 4);      /* bytes per second */
+  WriteLE(header+32, frameSize, 2);
+  WriteLE(header+34, BITS(format), 2);
+  memcpy(header+36, "data", 4);
+  WriteLE(header+40, dataBytes, 4);
+}
+
+static void WriteWaveHeader()
+{ Uint8 header[44];
+  GLM_writeWaveHeader(header, sink.spec.freq, sink.spec.format, sink.spec.channels, sink.dataBytes);
+  fseek(sink.file, 0, SEEK_SET);
+  fwrite(header, sizeof(header), 1, sink.file);
+}
+
+static int SinkThread(void *unused)
+{ Uint32 start=SDL_GetTicks(), frames=0, due, now;
+  (void)unused;
+  while(!sink.quit)
+  { if(sink.paused)
+    { SDL_Delay(10);
+      start=SDL_GetTicks(), frames=0;
+      continue;
+    }
+
+    SDL_LockMutex(sink.lock);
+    sink.spec.callback(sink.spec.userdata, sink.buffer, sink.spec.size);
+    SDL_UnlockMutex(sink.lock);
+    if(sink.file && fwrite(sink.buffer, sink.spec.size, 1, sink.file)==1) sink.dataBytes += sink.spec.size;
+
+    /* sleep until the buffer would have finished playing */
+    frames += sink.spec.samples;
+    if(frames>=(Uint32)sink.spec.freq) start+=1000, frames-=sink.spec.freq;
+    due = start + (Uint32)((Uint64)frames*1000/sink.spec.freq);
+    now = SDL_GetTicks();
+    if((Sint32)(due-now)>0) SDL_Delay(due-now);
+    else if((Sint32)(now-due)>1000) start=now, frames=0; /* we fell far behind (eg, in a debugger). don't try to catch up */
+  }
+  return 0;
+}
+
+static int SinkOpen(SDL_AudioSpec *desired, SDL_AudioSpec *obtained)
+{ *obtained = *desired;
+  if(FLOAT(obtained->format) || (BITS(obtained->format)!=8 && BITS(obtained->format)!=16))
+    obtained->format = MAKESE(0x8010);
+  if(obtained->channels<1 || obtained->channels>2) obtained->channels = 2;
+  if(obtained->freq<=0) obtained->freq = 22050;
+  if(!obtained->samples) obtained->samples = 1024;
+  obtained->silence = (Uint8)(SIGNED(obtained->format) ? 0 : 0x80);
+  obtained->size    = obtained->samples*obtained->channels*BYTES(obtained->format);
+
+  sink.spec      = *obtained;
+  sink.dataBytes = 0;
+  sink.paused    = 1;
+  sink.quit      = 0;
+  sink.buffer    = (Uint8*)malloc(obtained->size);
+  sink.lock      = SDL_CreateMutex();
+  if(!sink.buffer || !sink.lock)
+  { SDL_SetError("Out of memory");
+    goto error;
+  }
+  sink.thread = SDL_CreateThread(SinkThread, NULL);
+  if(!sink.thread) goto error;
+  return 0;
+
+  error:
+  if(sink.lock) SDL_DestroyMutex(sink.lock);
+  free(sink.buffer);
+  sink.lock=NULL, sink.buffer=NULL;
+  return -1;
+}
+
+static void SinkClose()
+{ sink.quit = 1;
+  SDL_WaitThread(sink.thread, NULL);
+  if(sink.file)
+  { WriteWaveHeader();
+    fclose(sink.file);
+  }
+  SDL_DestroyMutex(sink.lock);
+  free(sink.buffer);
+  memset(&sink, 0, sizeof(sink));
+}
+
+static void SinkPause(int pause) { sink.paused = pause; }
+static void SinkLock()           { SDL_LockMutex(sink.lock); }
+static void SinkUnlock()         { SDL_UnlockMutex(sink.lock); }
+
+static int NullOpen(SDL_AudioSpec *desired, SDL_AudioSpec *obtained, const char *arg)
+{ (void)arg;
+  return SinkOpen(desired, obtained);
+}
+
+static int WaveOpen(SDL_AudioSpec *desired, SDL_AudioSpec *obtained, const char *path)
+{ SDL_AudioSpec spec = *desired;
+  if(!path)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  spec.format = BITS(spec.format)==8 ? 0x0008 : 0x8010; /* WAV files are unsigned 8-bit or signed little-endian 16-bit */
+
+  sink.file = fopen(path, "wb");
+  if(!sink.file)
+  { SDL_SetError("Unable to open %s", path);
+    return -1;
+  }
+  if(SinkOpen(&spec, obtained)<0)
+  { fclose(sink.file);
+    sink.file = NULL;
+    return -1;
+  }
+  WriteWaveHeader(); /* write a placeholder header. it'll be rewritten with the correct sizes when the file is closed */
+  return 0;
+}
+
+const GLM_Backend GLM_nullBackend = { NullOpen, SinkClose, SinkPause, SinkLock, SinkUnlock };
+const GLM_Backend GLM_waveBackend = { WaveOpen, SinkClose, SinkPause, SinkLock, SinkUnlock };
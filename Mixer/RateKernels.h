@@ -0,0 +1,73 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* the sample rate conversion kernels, written once and instantiated by Mixer.c for each sample type. this file has no
+   include guard, since it's included once per instantiation, with these macros defined:
+     KERNEL       the suffix for the names of the generated functions, eg S16
+     CHANS        the number of channels, 1 or 2
+     SAMPLE       the type of a sample in memory
+     CALC         the type that samples are interpolated in
+     LOAD(p)      reads the sample at p as a CALC, swapping its bytes if necessary
+     STORE(p, v)  stores the CALC v as a sample at p
+   CHANS is undefined at the end, so that the next instantiation can set it. the others are left to the includer.
+*/
+
+#define RK_CAT2(name, chans, kernel) name##chans##_##kernel
+#define RK_CAT(name, chans, kernel) RK_CAT2(name, chans, kernel)
+#define RK_NAME(name) RK_CAT(name, CHANS, KERNEL)
+
+/* halves the rate by averaging pairs of frames, in place */
+static void RK_NAME(HalveRate)(Uint8 *buf, Uint32 frames)
+{ SAMPLE *src = (SAMPLE*)buf, *dest = src;
+  Uint32 i, c;
+  for(i=0; i<frames; src+=CHANS*2,dest+=CHANS,i++)
+    for(c=0; c<CHANS; c++) STORE(dest+c, (LOAD(src+c)+LOAD(src+CHANS+c))/2);
+}
+
+/* converts 'srcFrames' frames to 'destFrames' frames by linear interpolation. each output frame advances the source
+   position by sinc/sid frames. 'dest' may be the same as 'src' if the rate is being lowered
+*/
+static void RK_NAME(ConvertRate)(const Uint8 *srcBuf, Uint8 *destBuf, Uint32 srcFrames, Uint32 destFrames, int sinc,
+                                 int sid)
+{ const SAMPLE *src = (const SAMPLE*)srcBuf;
+  SAMPLE *dest = (SAMPLE*)destBuf;
+  CALC   s0[CHANS], diff[CHANS];
+  Uint32 i, c, si=1;
+  int    sic=0;
+
+  for(c=0; c<CHANS; c++)
+  { s0[c]   = LOAD(src+c);
+    diff[c] = LOAD(src+CHANS+c) - s0[c];
+    dest[c] = src[c];
+  }
+  for(i=1; i<destFrames; i++)
+  { sic += sinc;
+    if(sic>sid)
+    { do si++, sic-=sid; while(sic>=sid);
+      for(c=0; c<CHANS; c++)
+      { s0[c]   = LOAD(src+(si-1)*CHANS+c);
+        diff[c] = si>=srcFrames ? 0 : LOAD(src+si*CHANS+c) - s0[c];
+      }
+    }
+    for(c=0; c<CHANS; c++) STORE(dest+i*CHANS+c, s0[c]+diff[c]*sic/sid);
+  }
+}
+
+#undef RK_NAME
+#undef RK_CAT
+#undef RK_CAT2
+#undef CHANS
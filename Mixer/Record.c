@@ -0,0 +1,227 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* recording of the mixer's output. the mix callback copies each finished buffer into a single-producer,
+   single-consumer ring, and a writer thread drains the ring into a WAV file, so the audio thread never touches the
+   disk or takes a lock. if the writer falls behind, whole buffers are dropped rather than blocking the mixer, and the
+   drops are counted so that a damaged recording can be noticed.
+*/
+
+#include "Internal.h"
+#include "SDL_thread.h"
+#include "SDL_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RING_MS    2000 /* the minimum length of audio that the ring can hold */
+#define CHUNK_SIZE 4096 /* the number of samples converted per write */
+
+typedef struct
+{ FILE   *file;
+  Uint8  *ring;
+  Uint32 mask;                    /* the ring size minus one. the size is a power of two */
+  volatile Uint32 head, tail;     /* free-running byte counts, written only by the producer and consumer respectively */
+  volatile int quit, failed;
+  Uint32 freq, dataBytes;
+  Uint16 srcFormat, format;       /* the output format and the file format */
+  Uint8  channels;
+  Uint64 framesWritten;
+  volatile Uint32 framesDropped, overflows;
+  SDL_Thread *thread;
+} Recorder;
+
+static Recorder rec;
+static volatile int recording; /* set while the mix callback should feed the ring */
+
+static int WriteWaveHeader()
+{ Uint8 header[44];
+  GLM_writeWaveHeader(header, rec.freq, rec.format, rec.channels, rec.dataBytes);
+  return fseek(rec.file, 0, SEEK_SET)==0 && fwrite(header, sizeof(header), 1, rec.file)==1 ? 0 : -1;
+}
+
+/* reads an output sample as a signed 16-bit value, clipping floats */
+static Sint32 ReadSample(const Uint8 *p, Uint16 format)
+{ float v = GLM_readSample(p, format);
+  return v>=32767 ? 32767 : v<=-32768 ? -32768 : (Sint32)v;
+}
+
+/* converts and writes up to CHUNK_SIZE samples from the ring, starting at 'pos' */
+static int WriteChunk(Uint32 pos, Uint32 samples)
+{ Uint8  buffer[CHUNK_SIZE*2];
+  Uint32 sampleSize = BYTES(rec.srcFormat), i;
+  Uint8  *out = buffer;
+
+  for(i=0; i<samples; pos+=sampleSize,i++)
+  { Sint32 v;
+    if(sampleSize<=2) v = ReadSample(rec.ring+(pos&rec.mask), rec.srcFormat);
+    else /* floats may wrap around the end of the ring */
+    { Uint8 sample[8];
+      Uint32 j;
+      for(j=0; j<sampleSize; j++) sample[j] = rec.ring[(pos+j)&rec.mask];
+      v = ReadSample(sample, rec.srcFormat);
+    }
+    if(rec.format==AUDIO_U8) *out++ = (Uint8)((v>>8)+128);
+    else out[0] = (Uint8)v, out[1] = (Uint8)(v>>8), out+=2;
+  }
+  return fwrite(buffer, out-buffer, 1, rec.file)==1 ? 0 : -1;
+}
+
+static int WriterThread(void *unused)
+{ Uint32 applied=0, sampleSize = BYTES(rec.srcFormat);
+  (void)unused;
+  while(1)
+  { Uint32 tail = rec.tail, available, samples;
+    int quit = rec.quit;
+    GLM_BARRIER(); /* read the data only after seeing the head that covers it */
+    available = rec.head - tail;
+    if(!available)
+    { if(quit) break;
+      GLM_applyThreadPolicy(GLM_THREAD_WORKER, &applied);
+      SDL_Delay(10);
+      continue;
+    }
+
+    samples = available/sampleSize;
+    if(samples>CHUNK_SIZE) samples = CHUNK_SIZE - CHUNK_SIZE%rec.channels;
+    if(!rec.failed)
+    { if(WriteChunk(tail, samples)==0) rec.dataBytes += samples*BYTES(rec.format);
+      else rec.failed=1; /* keep draining the ring so the mixer doesn't see overflows */
+    }
+    rec.framesWritten += samples/rec.channels;
+    GLM_BARRIER(); /* finish reading before giving the space back */
+    rec.tail = tail + samples*sampleSize;
+  }
+  return 0;
+}
+
+/* called by the mix callback with each finished output buffer. this never blocks; if the ring doesn't have room, the
+   buffer is dropped and counted
+*/
+void GLM_recordOutput(const Uint8 *data, Uint32 bytes)
+{ Uint32 head, space, offset, first;
+  if(!recording) return;
+
+  head  = rec.head;
+  space = rec.mask+1 - (head-rec.tail);
+  if(bytes>space)
+  { rec.overflows++;
+    rec.framesDropped += bytes/(BYTES(rec.srcFormat)*rec.channels);
+    return;
+  }
+  offset = head&rec.mask;
+  first  = rec.mask+1-offset;
+  if(first>=bytes) memcpy(rec.ring+offset, data, bytes);
+  else
+  { memcpy(rec.ring+offset, data, first);
+    memcpy(rec.ring, data+first, bytes-first);
+  }
+  GLM_BARRIER(); /* publish the data before the head */
+  rec.head = head+bytes;
+}
+
+/* starts recording the mixer's output into a WAV file. 'format' is the file's sample format, AUDIO_U8 or
+   AUDIO_S16LSB, or zero to use 8-bit samples if the output is 8-bit and 16-bit samples otherwise. the mixer must be
+   initialized, and any current recording is stopped first
+*/
+int GLM_StartRecording(const char *path, Uint16 format)
+{ Uint32 freq, bytes, size;
+  Uint16 srcFormat;
+  Uint8  channels, header[44];
+
+  if(!path)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(GLM_GetFormat(&freq, &srcFormat, &channels, &bytes)<0) return -1;
+  if(!format) format = BITS(srcFormat)==8 ? AUDIO_U8 : AUDIO_S16LSB;
+  if(format!=AUDIO_U8 && format!=AUDIO_S16LSB)
+  { SDL_SetError("Unsupported format");
+    return -1;
+  }
+  GLM_StopRecording();
+
+  memset(&rec, 0, sizeof(rec));
+  for(size=65536; size<freq*channels*BYTES(srcFormat)/1000*RING_MS || size<bytes*4; size<<=1);
+  rec.ring = (Uint8*)malloc(size);
+  if(!rec.ring)
+  { SDL_SetError("Out of memory");
+    return -1;
+  }
+  rec.file = fopen(path, "wb");
+  if(!rec.file)
+  { free(rec.ring);
+    SDL_SetError("Unable to create file: %s", path);
+    return -1;
+  }
+  memset(header, 0, sizeof(header));
+  fwrite(header, sizeof(header), 1, rec.file); /* reserve space for the header, which is written at the end */
+  rec.mask      = size-1;
+  rec.freq      = freq;
+  rec.srcFormat = srcFormat;
+  rec.format    = format;
+  rec.channels  = channels;
+  rec.thread    = SDL_CreateThread(WriterThread, NULL);
+  if(!rec.thread)
+  { fclose(rec.file);
+    remove(path);
+    free(rec.ring);
+    memset(&rec, 0, sizeof(rec));
+    SDL_SetError("Unable to create the writer thread");
+    return -1;
+  }
+  GLM_BARRIER();
+  recording = 1;
+  return 0;
+}
+
+/* stops recording, writes the rest of the ring to the file, and finishes the WAV header. returns -1 if anything
+   couldn't be written
+*/
+int GLM_StopRecording()
+{ int ok;
+  if(!rec.thread) return 0;
+  GLM_LockAudio(); /* make sure the callback isn't in the middle of writing a buffer */
+  recording = 0;
+  GLM_UnlockAudio();
+
+  rec.quit = 1;
+  SDL_WaitThread(rec.thread, NULL);
+  ok = !rec.failed && WriteWaveHeader()==0;
+  if(fclose(rec.file)!=0) ok=0;
+  free(rec.ring);
+  rec.thread = NULL, rec.file = NULL, rec.ring = NULL; /* keep the statistics */
+  if(!ok)
+  { SDL_SetError("Unable to write the recording");
+    return -1;
+  }
+  return 0;
+}
+
+/* retrieves the statistics for the current recording, or the last one if none is in progress */
+int GLM_GetRecordingStats(GLM_RecordStats *stats)
+{ if(!stats)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  stats->framesWritten = rec.framesWritten;
+  stats->framesDropped = rec.framesDropped;
+  stats->overflows     = rec.overflows;
+  stats->recording     = rec.thread!=NULL;
+  stats->failed        = rec.failed;
+  return 0;
+}
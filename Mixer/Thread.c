@@ -0,0 +1,208 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* scheduling policy for the mixer's threads. we don't own the audio thread (SDL creates it), so a policy is only
+   recorded by GLM_SetThreadPolicy, and each thread applies it to itself the next time it calls
+   GLM_applyThreadPolicy. the result is recorded so that it can be checked with GLM_GetThreadPolicy.
+*/
+
+#ifndef WIN32
+#define _GNU_SOURCE /* for sched_setaffinity */
+#endif
+
+#include "Internal.h"
+#include "SDL_timer.h"
+#include <string.h>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+/* the requested policy is published with a sequence lock. the generation is odd while the policy is being written,
+   so readers can tell when they may have copied a half-written one
+*/
+typedef struct
+{ GLM_ThreadPolicy requested, effective;
+  volatile Uint32  generation, applied; /* the generation of the requested and most recently applied policies */
+} PolicyState;
+
+/* copies the requested policy, returning its generation, or an odd number if it was being changed during the copy */
+static Uint32 ReadRequested(PolicyState *state, GLM_ThreadPolicy *requested)
+{ Uint32 generation = state->generation;
+  GLM_BARRIER();
+  *requested = state->requested;
+  GLM_BARRIER();
+  return state->generation==generation ? generation : 1;
+}
+
+static PolicyState policies[GLM_THREAD_WORKER+1];
+
+#ifdef WIN32
+static void ApplyPolicy(const GLM_ThreadPolicy *req, GLM_ThreadPolicy *eff)
+{ HANDLE thread = GetCurrentThread();
+  int priority;
+
+  if(req->policy!=GLM_SCHED_NORMAL) priority = THREAD_PRIORITY_TIME_CRITICAL;
+  else if(req->priority<=-15) priority = THREAD_PRIORITY_HIGHEST;
+  else if(req->priority<0)    priority = THREAD_PRIORITY_ABOVE_NORMAL;
+  else if(req->priority==0)   priority = THREAD_PRIORITY_NORMAL;
+  else if(req->priority<15)   priority = THREAD_PRIORITY_BELOW_NORMAL;
+  else priority = THREAD_PRIORITY_LOWEST;
+
+  if(SetThreadPriority(thread, priority)) *eff = *req, eff->affinity = 0;
+  else eff->policy = GLM_SCHED_NORMAL, eff->priority = 0;
+  if(req->affinity && SetThreadAffinityMask(thread, (DWORD_PTR)req->affinity)) eff->affinity = req->affinity;
+}
+#else
+static void ApplyPolicy(const GLM_ThreadPolicy *req, GLM_ThreadPolicy *eff)
+{ struct sched_param param;
+  int policy = req->policy==GLM_SCHED_FIFO ? SCHED_FIFO : req->policy==GLM_SCHED_RR ? SCHED_RR : SCHED_OTHER, done=0;
+
+  memset(&param, 0, sizeof(param));
+  if(policy!=SCHED_OTHER)
+  { int min=sched_get_priority_min(policy), max=sched_get_priority_max(policy);
+    param.sched_priority = req->priority<min ? min : req->priority>max ? max : req->priority;
+    done = pthread_setschedparam(pthread_self(), policy, &param)==0;
+  }
+  if(!done) /* realtime scheduling wasn't requested or isn't permitted, so fall back to a nice value */
+  { param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    #ifdef __linux__ /* linux applies nice values per thread */
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid),
+                policy!=SCHED_OTHER ? -20 : req->priority<-20 ? -20 : req->priority>19 ? 19 : req->priority);
+    #endif
+  }
+  #ifdef __linux__
+  if(req->affinity)
+  { cpu_set_t set;
+    int i;
+    CPU_ZERO(&set);
+    for(i=0; i<64; i++) if(req->affinity & ((Uint64)1<<i)) CPU_SET(i, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+  #endif
+
+  /* read back what the thread actually got */
+  if(pthread_getschedparam(pthread_self(), &policy, &param)==0 && policy!=SCHED_OTHER)
+  { eff->policy   = policy==SCHED_FIFO ? GLM_SCHED_FIFO : GLM_SCHED_RR;
+    eff->priority = param.sched_priority;
+  }
+  else
+  { eff->policy = GLM_SCHED_NORMAL;
+    #ifdef __linux__
+    eff->priority = getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid));
+    #else
+    eff->priority = 0;
+    #endif
+  }
+  eff->affinity = 0;
+  #ifdef __linux__
+  { cpu_set_t set;
+    int i;
+    if(sched_getaffinity(0, sizeof(set), &set)==0)
+      for(i=0; i<64; i++) if(CPU_ISSET(i, &set)) eff->affinity |= (Uint64)1<<i;
+  }
+  #endif
+}
+#endif
+
+/* applies the policy for the given kind of thread to the calling thread if it has changed since '*applied' */
+void GLM_applyThreadPolicy(int thread, Uint32 *applied)
+{ PolicyState *state = &policies[thread];
+  GLM_ThreadPolicy requested;
+  Uint32 generation;
+  if(*applied==state->generation) return;
+  generation = ReadRequested(state, &requested);
+  if(generation&1) return; /* it's being changed right now, so try again next time rather than waiting */
+  ApplyPolicy(&requested, &state->effective);
+  *applied = state->applied = generation;
+}
+
+/* the exported form of GLM_applyThreadPolicy, for worker threads created outside the mixer (eg, by managed code) */
+int GLM_UpdateThreadPolicy(int thread, Uint32 *applied)
+{ if(!applied)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(thread<GLM_THREAD_AUDIO || thread>GLM_THREAD_WORKER)
+  { SDL_SetError("Invalid thread type");
+    return -1;
+  }
+  GLM_applyThreadPolicy(thread, applied);
+  return 0;
+}
+
+int GLM_SetThreadPolicy(int thread, const GLM_ThreadPolicy *policy)
+{ if(!policy)
+  { SDL_SetError("NULL pointer passed");
+    return -1;
+  }
+  if(thread<GLM_THREAD_AUDIO || thread>GLM_THREAD_WORKER)
+  { SDL_SetError("Invalid thread type");
+    return -1;
+  }
+  if(policy->policy<GLM_SCHED_NORMAL || policy->policy>GLM_SCHED_RR)
+  { SDL_SetError("Invalid scheduling policy");
+    return -1;
+  }
+  if(policy->policy==GLM_SCHED_NORMAL ? policy->priority<-20 || policy->priority>19 :
+                                        policy->priority<1 || policy->priority>99)
+  { SDL_SetError("Invalid thread priority");
+    return -1;
+  }
+  if(thread==GLM_THREAD_WORKER && policy->policy!=GLM_SCHED_NORMAL)
+  { SDL_SetError("Worker threads do offline work and can't use realtime scheduling");
+    return -1;
+  }
+
+  { PolicyState *state = &policies[thread];
+    Uint32 generation;
+    do generation = state->generation; while((generation&1) || !GLM_CAS(&state->generation, generation, generation+1));
+    GLM_BARRIER();
+    state->requested = *policy;
+    GLM_BARRIER();
+    state->generation = generation+2;
+  }
+  return 0;
+}
+
+/* retrieves the policy in effect for the given kind of thread. returns 1 if the latest policy has been applied, 0 if
+   it's still pending (eg, the audio thread hasn't run since it was set), or -1 on error
+*/
+int GLM_GetThreadPolicy(int thread, GLM_ThreadPolicy *requested, GLM_ThreadPolicy *effective)
+{ if(thread<GLM_THREAD_AUDIO || thread>GLM_THREAD_WORKER)
+  { SDL_SetError("Invalid thread type");
+    return -1;
+  }
+  { PolicyState *state = &policies[thread];
+    GLM_ThreadPolicy copy;
+    Uint32 generation;
+    while((generation=ReadRequested(state, &copy)) & 1) SDL_Delay(0);
+    if(requested) *requested = copy;
+    if(effective) *effective = state->effective;
+    return state->applied==generation;
+  }
+}
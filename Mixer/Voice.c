@@ -0,0 +1,619 @@
+/*
+GameLib is a library for developing games and other multimedia applications.
+Copyright (C) 2002-2004 Adam Milazzo
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* per-voice processing state. voices are numbered like the managed channels. the table is resized with the audio
+   locked, so it must not be resized from inside the mix callback.
+
+   voices can also belong to up to 32 groups. group commands (pause, stop, etc) are posted to a lock-free queue and
+   applied by the mixer thread at the start of the next buffer, in one pass over the voices, so the caller never waits
+   for the mixer. the results are left in the voice controls, which the mix callback reads to act on them.
+
+   a voice's generation is bumped whenever it starts or stops a sound, and voice handles combine the voice number with
+   the generation, so that commands sent through a handle are ignored once the voice has moved on to another sound.
+
+   voices can have their volume, pan and rate automated with breakpoint envelopes. the envelopes are moved forward
+   once per buffer, the rate is evaluated at the start of the buffer, and the gains are evaluated every AUTO_BLOCK
+   frames and ramped in between while the mix callback applies them with GLM_AutomateVoice.
+
+   voices can also have an ADSR envelope, which is applied along with the automated volume. the attack starts when the
+   voice is acquired for a new sound (or on a note-on command), the sustain level is held until a note-off command, and
+   the voice is stopped once its release ends. the envelope runs entirely on the mixer thread.
+*/
+
+#include "Internal.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COEF_ONE   65536
+#define MAX_GROUPS 32
+#define CMD_QUEUE  256 /* must be a power of two */
+#define MAX_VOICES 65535
+#define HANDLE(voice, gen) (((gen)<<16) | (voice))
+#define HANDLE_VOICE(h) ((h)&0xFFFF)
+#define HANDLE_GEN(h)   ((h)>>16)
+#define AUTO_BLOCK 32
+#define AUTO_GAINS ((1<<GLM_PARAM_VOLUME) | (1<<GLM_PARAM_PAN) | GLM_ADSR_ACTIVE)
+#define EXP_FLOOR  (1.0f/1024) /* exponential segments to or from zero use this level (-60dB) instead */
+#define CMD_GROUPS (GLM_GROUP_NOTEOFF+1) /* an internal command that sets a voice's groups */
+
+enum { ADSR_ATTACK, ADSR_DECAY, ADSR_RELEASE, ADSR_SUSTAIN, ADSR_DONE };
+
+typedef struct
+{ Uint32 pos;   /* the position within the stage, in frames */
+  float  from;  /* the level at the start of the stage */
+  Uint8  stage;
+} AdsrState;
+#define SETTLED(s) ((s)<COEF_ONE && (s)>-COEF_ONE) /* whether a 16.16 filter state rounds to silence */
+
+typedef struct
+{ Sint64 lpState[2], hpState[2]; /* filter outputs, in 16.16 fixed point */
+  Sint32 lpCoef, hpCoef;         /* the coefficients in use, in 16.16 fixed point */
+  Sint32 lpTarget, hpTarget;     /* the coefficients to smooth towards over the next buffer */
+  Uint8  hpOn;                   /* whether the high-pass filter is enabled */
+  Uint16 cut;                    /* 256 minus the volume set through the voice's handle */
+  Uint32 adsrLength[3];          /* the attack, decay and release times, in frames */
+  Uint8  adsrCurve[3], adsrOn;
+  float  sustain;
+  Uint32 adsrGen;                /* the generation that the envelope was started for */
+  AdsrState adsr, adsrStart;     /* the envelope's current state, and its state at the start of the buffer */
+} Voice;
+
+typedef struct
+{ volatile Uint32 seq;   /* the queue position this slot is ready for, minus the slot index (so zero is a valid start) */
+  Uint32 mask, handle;    /* the target groups, or if 'handle' is nonzero, the target voice. for CMD_GROUPS, 'mask' is
+                             the voice and 'arg' is its new groups */
+  Sint32 command, arg;
+} Command;
+
+static Voice            *voices;
+static GLM_VoiceControl *controls;
+static Uint32           *voiceGroups;    /* the group membership bitmask of each voice */
+static volatile Uint32  *generations;    /* the generation of each voice, from 1 to 65535 */
+static GLM_Envelope     **automation;    /* each voice's envelopes, indexed by GLM_PARAM_*, or NULL if never automated */
+static Uint32           voiceCount, voiceFreq;
+static Uint8            voiceChans, controlsDirty, controlsSeen; /* seen: the mix callback has run since they were set */
+static Uint16           groupCut[MAX_GROUPS]; /* 256 minus each group's volume, so that zero is the default */
+static Command          commands[CMD_QUEUE];
+static volatile Uint32  cmdTail;         /* the next position to be claimed by a producer */
+static Uint32           cmdHead;         /* the next position to be consumed by the mixer */
+
+/* returns the one-pole coefficient for the given cutoff, where COEF_ONE passes the input unchanged */
+static Sint32 CutoffToCoef(Uint32 cutoff)
+{ if(!cutoff || cutoff>=voiceFreq/2) return COEF_ONE;
+  return (Sint32)((1-exp(-2*3.14159265358979*cutoff/voiceFreq)) * COEF_ONE + 0.5);
+}
+
+/* clears the voice's history, eg, when it starts playing a new sound, but keeps its settings */
+static void ResetVoice(Voice *v)
+{ memset(v->lpState, 0, sizeof(v->lpState));
+  memset(v->hpState, 0, sizeof(v->hpState));
+  v->lpCoef = v->lpTarget;
+  v->hpCoef = v->hpTarget;
+  v->hpOn   = v->hpTarget!=0;
+}
+
+/* returns the product of the voice's group volumes and its own volume */
+static Uint16 VoiceVolume(Uint32 voice)
+{ Uint32 volume=256-voices[voice].cut, groups=voiceGroups[voice], i;
+  for(i=0; groups; groups>>=1,i++) if(groups&1) volume = (volume*(256-groupCut[i]))>>8;
+  return (Uint16)volume;
+}
+
+static float Interpolate(float a, float b, float t, int curve)
+{ if(curve==GLM_CURVE_LINEAR) return a+(b-a)*t;
+  if(a<EXP_FLOOR) a=EXP_FLOOR;
+  if(b<EXP_FLOOR) b=EXP_FLOOR;
+  return a*(float)pow(b/a, t);
+}
+
+/* moves the ADSR state forward by the given number of frames and returns the level there */
+static float StepAdsr(const Voice *v, AdsrState *s, Uint32 frames)
+{ float target;
+  s->pos += frames;
+  for(;;)
+  { if(s->stage>=ADSR_SUSTAIN)
+    { s->pos = 0;
+      return s->stage==ADSR_SUSTAIN ? v->sustain : 0;
+    }
+    target = s->stage==ADSR_ATTACK ? 1 : s->stage==ADSR_DECAY ? v->sustain : 0;
+    if(s->pos<v->adsrLength[s->stage])
+      return Interpolate(s->from, target, (float)s->pos/v->adsrLength[s->stage], v->adsrCurve[s->stage]);
+    s->pos  -= v->adsrLength[s->stage];
+    s->from  = target;
+    s->stage = s->stage==ADSR_ATTACK ? ADSR_DECAY : s->stage==ADSR_DECAY ? ADSR_SUSTAIN : ADSR_DONE;
+  }
+}
+
+/* starts the attack if the voice has moved on to a new sound since the envelope was last started */
+static void SyncAdsr(Uint32 voice)
+{ Voice *v = voices+voice;
+  if(v->adsrGen!=generations[voice])
+  { v->adsr.stage=ADSR_ATTACK, v->adsr.pos=0, v->adsr.from=0;
+    v->adsrGen = generations[voice];
+  }
+}
+
+static void Note(Uint32 voice, int on)
+{ Voice *v = voices+voice;
+  if(!v->adsrOn) return;
+  SyncAdsr(voice);
+  if(on || v->adsr.stage<ADSR_RELEASE || v->adsr.stage==ADSR_SUSTAIN) /* start from the current level */
+  { v->adsr.from  = StepAdsr(v, &v->adsr, 0);
+    v->adsr.stage = on ? ADSR_ATTACK : ADSR_RELEASE;
+    v->adsr.pos   = 0;
+  }
+}
+
+/* clears the voice's automation without waiting for the mixer */
+static void ClearAutomation(Uint32 voice)
+{ Uint32 i;
+  if(automation[voice])
+    for(i=0; i<=GLM_PARAM_RATE; i++)
+      if(automation[voice][i].pending.count) GLM_setEnvelope(&automation[voice][i], NULL, 0, voiceFreq, 0, 0);
+}
+
+static Uint32 BumpGeneration(Uint32 voice)
+{ Uint32 gen, next;
+  do
+  { gen  = generations[voice];
+    next = (gen+1) & 0xFFFF;
+    if(!next) next=1;
+  } while(!GLM_CAS(&generations[voice], gen, next));
+  return next;
+}
+
+int GLM_AllocateVoices(Uint32 count)
+{ Voice  *nv=NULL, *ov;
+  GLM_VoiceControl *nc=NULL, *oc;
+  Uint32 *ng=NULL, *og, *ngen=NULL, *ogen, i, keep, oldCount;
+  GLM_Envelope **na=NULL, **oa;
+  Uint16 format;
+
+  if(count)
+  { if(GLM_GetFormat(&voiceFreq, &format, &voiceChans, NULL)<0) return -1;
+    if(voiceChans>2)
+    { SDL_SetError("Unsupported number of channels.");
+      return -1;
+    }
+    if(count>MAX_VOICES)
+    { SDL_SetError("Too many voices");
+      return -1;
+    }
+    nv   = (Voice*)malloc(count*sizeof(Voice));
+    nc   = (GLM_VoiceControl*)malloc(count*sizeof(GLM_VoiceControl));
+    ng   = (Uint32*)malloc(count*sizeof(Uint32));
+    ngen = (Uint32*)malloc(count*sizeof(Uint32));
+    na   = (GLM_Envelope**)malloc(count*sizeof(GLM_Envelope*));
+    if(!nv || !nc || !ng || !ngen || !na)
+    { free(nv);
+      free(nc);
+      free(ng);
+      free(ngen);
+      free(na);
+      SDL_SetError("Out of memory");
+      return -1;
+    }
+  }
+
+  GLM_LockAudio();
+  keep = count<voiceCount ? count : voiceCount;
+  if(keep)
+  { memcpy(nv, voices, keep*sizeof(Voice));
+    memcpy(nc, controls, keep*sizeof(GLM_VoiceControl));
+    memcpy(ng, voiceGroups, keep*sizeof(Uint32));
+    memcpy(ngen, (Uint32*)generations, keep*sizeof(Uint32));
+    memcpy(na, automation, keep*sizeof(GLM_Envelope*));
+  }
+  for(i=keep; i<count; i++)
+  { memset(nv+i, 0, sizeof(Voice));
+    nv[i].lpCoef = nv[i].lpTarget = COEF_ONE;
+    nc[i].flags=0, nc[i].volume=256, nc[i].fadeMs=0, nc[i].rate=1, nc[i].automation=0;
+    ng[i]=0, ngen[i]=1, na[i]=NULL;
+  }
+  ov=voices, oc=controls, og=voiceGroups, ogen=(Uint32*)generations, oa=automation, oldCount=voiceCount;
+  voices=nv, controls=nc, voiceGroups=ng, generations=ngen, automation=na, voiceCount=count;
+  if(!count) memset(groupCut, 0, sizeof(groupCut));
+  GLM_UnlockAudio();
+
+  for(i=keep; i<oldCount; i++) free(oa[i]);
+  free(ov);
+  free(oc);
+  free(og);
+  free(ogen);
+  free(oa);
+  return 0;
+}
+
+int GLM_ResetVoice(Uint32 voice)
+{ if(voice>=voiceCount)
+  { SDL_SetError("Invalid voice");
+    return -1;
+  }
+  ResetVoice(voices+voice);
+  return 0;
+}
+
+/* sets the cutoff frequencies of the low-pass and high-pass filters of the voice that the handle refers to, in Hz.
+   zero disables a filter. returns 1 if the filters were set, or 0 if the handle is stale
+*/
+int GLM_SetVoiceFilter(Uint32 handle, Uint32 lowPass, Uint32 highPass)
+{ Voice *v;
+  int voice = GLM_VoiceFromHandle(handle);
+  if(voice<0) return 0;
+  v = voices+voice;
+  v->lpTarget = CutoffToCoef(lowPass);
+  v->hpTarget = highPass ? CutoffToCoef(highPass) : 0;
+  if(highPass && !v->hpOn) v->hpOn=1, v->hpCoef=v->hpTarget; /* start tracking immediately, since the state is clear */
+  return 1;
+}
+
+/* filters a buffer of the voice's data in place, before it's scaled and mixed. returns 1 if the filters are active and
+   must be applied to the next buffer as well, or 0 if they pass data through unchanged (so the call can be skipped)
+*/
+int GLM_FilterVoice(Uint32 voice, Sint32 *buffer, Uint32 frames)
+{ Voice  *v;
+  Sint32 coef, step;
+  Uint32 i, c;
+
+  if(voice>=voiceCount || !buffer)
+  { SDL_SetError(buffer ? "Invalid voice" : "NULL pointer passed");
+    return -1;
+  }
+  v = voices+voice;
+  if(!frames) return 1;
+
+  if(v->lpCoef!=COEF_ONE || v->lpTarget!=COEF_ONE) /* low-pass, with the coefficient ramped across the buffer */
+  { coef = v->lpCoef, step = (v->lpTarget-coef)/(Sint32)frames;
+    for(c=0; c<voiceChans; c++)
+    { Sint64 s=v->lpState[c];
+      Sint32 *p=buffer+c, k=coef;
+      if(!step) for(i=0; i<frames; p+=voiceChans,i++) s += (Sint64)k * (*p - (Sint32)(s>>16)), *p = (Sint32)(s>>16);
+      else
+        for(i=0; i<frames; p+=voiceChans,k+=step,i++) s += (Sint64)k * (*p - (Sint32)(s>>16)), *p = (Sint32)(s>>16);
+      v->lpState[c] = s;
+    }
+    v->lpCoef = v->lpTarget;
+  }
+
+  if(v->hpOn) /* high-pass, by subtracting a low-pass at the high-pass cutoff */
+  { coef = v->hpCoef, step = (v->hpTarget-coef)/(Sint32)frames;
+    for(c=0; c<voiceChans; c++)
+    { Sint64 s=v->hpState[c];
+      Sint32 *p=buffer+c, k=coef;
+      if(v->hpTarget) /* enabled */
+        for(i=0; i<frames; p+=voiceChans,k+=step,i++) s += (Sint64)k * (*p - (Sint32)(s>>16)), *p -= (Sint32)(s>>16);
+      else /* disabled, so let the subtracted bass decay rather than stepping back in */
+        for(i=0; i<frames; p+=voiceChans,i++) s -= s/256, *p -= (Sint32)(s>>16);
+      v->hpState[c] = s;
+    }
+    v->hpCoef = v->hpTarget;
+    if(!v->hpTarget && SETTLED(v->hpState[0]) && (voiceChans==1 || SETTLED(v->hpState[1])))
+      v->hpOn=0, v->hpState[0]=v->hpState[1]=0;
+  }
+
+  return v->lpCoef!=COEF_ONE || v->hpOn;
+}
+
+/* starts a new generation of the voice, for a new sound, and returns a handle to it. the voice's own volume (set
+   through a handle) is reset. returns 0 on error
+*/
+Uint32 GLM_AcquireVoice(Uint32 voice)
+{ if(voice>=voiceCount)
+  { SDL_SetError("Invalid voice");
+    return 0;
+  }
+  voices[voice].cut = 0;
+  controls[voice].volume = VoiceVolume(voice);
+  ClearAutomation(voice);
+  return HANDLE(voice, BumpGeneration(voice));
+}
+
+/* invalidates the voice's handles, eg, when its sound ends */
+int GLM_ReleaseVoice(Uint32 voice)
+{ if(voice>=voiceCount)
+  { SDL_SetError("Invalid voice");
+    return -1;
+  }
+  BumpGeneration(voice);
+  return 0;
+}
+
+/* returns the voice that the handle refers to, or -1 if the handle is stale or invalid */
+int GLM_VoiceFromHandle(Uint32 handle)
+{ Uint32 voice = HANDLE_VOICE(handle);
+  return handle && voice<voiceCount && generations[voice]==HANDLE_GEN(handle) ? (int)voice : -1;
+}
+
+/* sets a GLM_PARAM_* envelope for the voice that the handle refers to, which the mixer starts following at the next
+   buffer. the last value is held after the envelope ends. a count of zero removes the automation. automation is also
+   removed when the voice is acquired for a new sound. returns 1 if the envelope was set, 0 if the handle is stale, or
+   -1 on error
+*/
+int GLM_SetVoiceAutomation(Uint32 handle, int param, const GLM_Breakpoint *points, Uint32 count)
+{ static const float mins[] = { 0, -1, 0 }, maxes[] = { 1, 1, 16 };
+  GLM_Envelope *env;
+  int voice;
+
+  if(param<GLM_PARAM_VOLUME || param>GLM_PARAM_RATE)
+  { SDL_SetError("Invalid parameter");
+    return -1;
+  }
+  voice = GLM_VoiceFromHandle(handle);
+  if(voice<0) return 0;
+  if(!automation[voice])
+  { if(!count) return 1;
+    env = (GLM_Envelope*)calloc(GLM_PARAM_RATE+1, sizeof(GLM_Envelope));
+    if(!env)
+    { SDL_SetError("Out of memory");
+      return -1;
+    }
+    GLM_BARRIER();
+    automation[voice] = env;
+  }
+  return GLM_setEnvelope(&automation[voice][param], points, count, voiceFreq, mins[param], maxes[param])<0 ? -1 : 1;
+}
+
+/* sets the ADSR envelope of the voice that the handle refers to. it applies to the current sound, and stays with the
+   voice for later sounds. a NULL envelope disables it. returns 1 if the envelope was set, 0 if the handle is stale, or
+   -1 on error
+*/
+int GLM_SetVoiceAdsr(Uint32 handle, const GLM_Adsr *adsr)
+{ Voice *v;
+  int voice;
+  if(adsr)
+  { if(adsr->attackCurve<GLM_CURVE_LINEAR  || adsr->attackCurve>GLM_CURVE_EXP ||
+       adsr->decayCurve<GLM_CURVE_LINEAR   || adsr->decayCurve>GLM_CURVE_EXP  ||
+       adsr->releaseCurve<GLM_CURVE_LINEAR || adsr->releaseCurve>GLM_CURVE_EXP)
+    { SDL_SetError("Invalid curve");
+      return -1;
+    }
+    if(!(adsr->sustain>=0 && adsr->sustain<=1))
+    { SDL_SetError("Invalid sustain level");
+      return -1;
+    }
+  }
+
+  voice = GLM_VoiceFromHandle(handle);
+  if(voice<0) return 0;
+  v = voices+voice;
+  if(!adsr)
+  { v->adsrOn = 0;
+    return 1;
+  }
+  v->adsrLength[ADSR_ATTACK]  = (Uint32)((Uint64)adsr->attackMs*voiceFreq/1000);
+  v->adsrLength[ADSR_DECAY]   = (Uint32)((Uint64)adsr->decayMs*voiceFreq/1000);
+  v->adsrLength[ADSR_RELEASE] = (Uint32)((Uint64)adsr->releaseMs*voiceFreq/1000);
+  v->adsrCurve[ADSR_ATTACK]   = (Uint8)adsr->attackCurve;
+  v->adsrCurve[ADSR_DECAY]    = (Uint8)adsr->decayCurve;
+  v->adsrCurve[ADSR_RELEASE]  = (Uint8)adsr->releaseCurve;
+  v->sustain = adsr->sustain;
+  if(!v->adsrOn)
+  { v->adsrGen = 0; /* restart the envelope. generations are never zero */
+    GLM_BARRIER();
+    v->adsrOn = 1;
+  }
+  return 1;
+}
+
+/* gets the automated gain of each output channel 'offset' frames into the buffer, in 16.16 fixed point */
+static void AutomatedGains(Uint32 voice, Uint32 active, Uint32 offset, Sint32 *gains)
+{ const GLM_Envelope *env = automation[voice];
+  float volume = active & (1<<GLM_PARAM_VOLUME) ? GLM_evalEnvelope(env+GLM_PARAM_VOLUME, offset) : 1;
+  float pan    = active & (1<<GLM_PARAM_PAN)    ? GLM_evalEnvelope(env+GLM_PARAM_PAN,    offset) : 0;
+  if(active & GLM_ADSR_ACTIVE)
+  { AdsrState s = voices[voice].adsrStart;
+    volume *= StepAdsr(voices+voice, &s, offset);
+  }
+  if(voiceChans==1) gains[0] = (Sint32)(volume*COEF_ONE);
+  else
+  { gains[0] = (Sint32)(volume*(pan>0 ? 1-pan : 1)*COEF_ONE);
+    gains[1] = (Sint32)(volume*(pan<0 ? 1+pan : 1)*COEF_ONE);
+  }
+}
+
+/* applies the voice's automated volume and pan and its ADSR envelope to 'frames' frames of its data, starting 'offset'
+   frames into the current buffer. returns 1 if the voice has any of those, or 0 if the call can be skipped
+*/
+int GLM_AutomateVoice(Uint32 voice, Sint32 *buffer, Uint32 offset, Uint32 frames)
+{ Sint32 gains[2], next[2], step[2];
+  Uint32 active, i, j, c, n;
+
+  if(voice>=voiceCount || !buffer)
+  { SDL_SetError(buffer ? "Invalid voice" : "NULL pointer passed");
+    return -1;
+  }
+  active = controls[voice].automation;
+  if(!(active&AUTO_GAINS)) return 0;
+
+  AutomatedGains(voice, active, offset, gains);
+  for(i=0; i<frames; i+=n)
+  { n = frames-i<AUTO_BLOCK ? frames-i : AUTO_BLOCK;
+    AutomatedGains(voice, active, offset+i+n, next);
+    for(c=0; c<voiceChans; c++) step[c] = (next[c]-gains[c])/(Sint32)n;
+    for(j=0; j<n; buffer+=voiceChans,j++)
+      for(c=0; c<voiceChans; c++) buffer[c] = (Sint32)(((Sint64)buffer[c]*gains[c])>>16), gains[c] += step[c];
+    for(c=0; c<voiceChans; c++) gains[c] = next[c];
+  }
+  return 1;
+}
+
+/* returns a pointer to the voice controls, which remain valid until the voices are reallocated. the mix callback
+   should act on any flags set in them, since they're cleared at the start of the next buffer
+*/
+GLM_VoiceControl* GLM_GetVoiceControls()
+{ return controls;
+}
+
+static int QueueCommand(Uint32 mask, Uint32 handle, int command, Sint32 arg)
+{ Command *cmd;
+  Uint32  pos;
+  Sint32  diff;
+
+  for(;;) /* claim a slot. this is a bounded multi-producer queue, so the game may post from any thread */
+  { pos  = cmdTail;
+    cmd  = commands + (pos&(CMD_QUEUE-1));
+    diff = (Sint32)(cmd->seq + (pos&(CMD_QUEUE-1)) - pos);
+    if(!diff)
+    { if(GLM_CAS(&cmdTail, pos, pos+1)) break;
+    }
+    else if(diff<0)
+    { SDL_SetError("The command queue is full");
+      return -1;
+    }
+  }
+  cmd->mask=mask, cmd->handle=handle, cmd->command=command, cmd->arg=arg;
+  GLM_BARRIER();
+  cmd->seq = pos+1 - (pos&(CMD_QUEUE-1)); /* publish it */
+  return 0;
+}
+
+static int PostCommand(Uint32 mask, Uint32 handle, int command, Sint32 arg)
+{ if(command<GLM_GROUP_PAUSE || command>GLM_GROUP_NOTEOFF)
+  { SDL_SetError("Invalid command");
+    return -1;
+  }
+  if(command==GLM_GROUP_VOLUME ? (!mask && !handle) || arg<0 || arg>256 : command==GLM_GROUP_FADEOUT && arg<0)
+  { SDL_SetError("Invalid command argument");
+    return -1;
+  }
+  return QueueCommand(mask, handle, command, arg);
+}
+
+/* sets the groups that the voice belongs to, as a bitmask. the change is queued for the mixer thread like a group
+   command, so it takes effect at the start of the next buffer, in order with the group commands around it. returns -1
+   if the command queue is full
+*/
+int GLM_SetVoiceGroups(Uint32 voice, Uint32 groups)
+{ if(voice>=voiceCount)
+  { SDL_SetError("Invalid voice");
+    return -1;
+  }
+  return QueueCommand(voice, 0, CMD_GROUPS, (Sint32)groups);
+}
+
+/* posts a GLM_GROUP_* command for the voices in any of the groups in 'mask' (or all voices if 'mask' is zero) without
+   waiting for the mixer. returns -1 if the command queue is full
+*/
+int GLM_PostGroupCommand(Uint32 mask, int command, Sint32 arg)
+{ return PostCommand(mask, 0, command, arg);
+}
+
+/* posts a GLM_GROUP_* command for a single voice, through its handle. the command is dropped if the handle goes stale
+   before the mixer gets to it. returns 1 if the command was posted, 0 if the handle is already stale, or -1 on error
+*/
+int GLM_PostVoiceCommand(Uint32 handle, int command, Sint32 arg)
+{ if(GLM_VoiceFromHandle(handle)<0) return 0;
+  return PostCommand(0, handle, command, arg)<0 ? -1 : 1;
+}
+
+static void ApplyCommand(Uint32 mask, Uint32 handle, int command, Sint32 arg)
+{ Uint32 i, count=voiceCount, *groups=voiceGroups;
+  GLM_VoiceControl *ctl=controls;
+  Uint16 set, clear;
+
+  if(command==CMD_GROUPS)
+  { if(mask<count) /* the voice count may have shrunk since the command was posted */
+    { groups[mask] = (Uint32)arg;
+      ctl[mask].volume = VoiceVolume(mask);
+    }
+    return;
+  }
+  if(command>=GLM_GROUP_NOTEON)
+  { if(handle)
+    { int voice = GLM_VoiceFromHandle(handle);
+      if(voice>=0) Note((Uint32)voice, command==GLM_GROUP_NOTEON);
+    }
+    else for(i=0; i<count; i++) if(!mask || (groups[i]&mask)) Note(i, command==GLM_GROUP_NOTEON);
+    return;
+  }
+
+  set   = command==GLM_GROUP_PAUSE ? GLM_VOICE_PAUSE : command==GLM_GROUP_RESUME ? GLM_VOICE_RESUME :
+          command==GLM_GROUP_STOP  ? GLM_VOICE_STOP  : GLM_VOICE_FADEOUT;
+  clear = set==GLM_VOICE_PAUSE ? GLM_VOICE_RESUME : set==GLM_VOICE_RESUME ? GLM_VOICE_PAUSE : 0;
+
+  if(handle) /* a single voice, if the handle is still current */
+  { int voice = GLM_VoiceFromHandle(handle);
+    if(voice<0) return;
+    if(command==GLM_GROUP_VOLUME)
+    { voices[voice].cut = (Uint16)(256-arg);
+      ctl[voice].volume = VoiceVolume(voice);
+      return;
+    }
+    ctl[voice].flags = (Uint16)((ctl[voice].flags&~clear)|set);
+    if(set==GLM_VOICE_FADEOUT) ctl[voice].fadeMs = (Uint32)arg;
+  }
+  else if(command==GLM_GROUP_VOLUME)
+  { for(i=0; i<MAX_GROUPS; i++) if(mask & ((Uint32)1<<i)) groupCut[i] = (Uint16)(256-arg);
+    for(i=0; i<count; i++) if(groups[i]&mask) ctl[i].volume = VoiceVolume(i);
+    return;
+  }
+  else if(!mask) for(i=0; i<count; i++) ctl[i].flags = (Uint16)((ctl[i].flags&~clear)|set);
+  else for(i=0; i<count; i++) if(groups[i]&mask) ctl[i].flags = (Uint16)((ctl[i].flags&~clear)|set);
+  if(set==GLM_VOICE_FADEOUT && !handle)
+    for(i=0; i<count; i++) if(!mask || (groups[i]&mask)) ctl[i].fadeMs = (Uint32)arg;
+  controlsDirty = 1, controlsSeen = 0;
+}
+
+/* called by the mixer thread for every buffer to clear the actions the mix callback has seen and apply new commands.
+   this happens even when the mix is skipped, so that the queue doesn't fill up, but then the actions are kept until a
+   callback gets to see them
+*/
+void GLM_processGroups()
+{ Command *cmd;
+  Uint32 i, slot;
+
+  if(controlsDirty && controlsSeen)
+  { for(i=0; i<voiceCount; i++) controls[i].flags=0;
+    controlsDirty=0;
+  }
+  for(;;)
+  { slot = cmdHead&(CMD_QUEUE-1);
+    cmd  = commands+slot;
+    if(cmd->seq + slot != cmdHead+1) break; /* the queue is empty, or the next command isn't published yet */
+    GLM_BARRIER();
+    ApplyCommand(cmd->mask, cmd->handle, cmd->command, cmd->arg);
+    GLM_BARRIER();
+    cmd->seq = cmdHead+CMD_QUEUE - slot; /* release the slot */
+    cmdHead++;
+  }
+}
+
+/* called by the mixer thread before the mix callback to move the voices' envelopes forward by a buffer. voices whose
+   ADSR release has ended are told to stop
+*/
+void GLM_processAutomation(Uint32 frames)
+{ GLM_Envelope *env;
+  Voice  *v;
+  Uint32 i, p, active;
+
+  for(i=0; i<voiceCount; i++)
+  { env=automation[i], v=voices+i, active=0;
+    if(env)
+      for(p=0; p<=GLM_PARAM_RATE; p++) if(GLM_advanceEnvelope(env+p, frames)) active |= 1<<p;
+    if(v->adsrOn)
+    { SyncAdsr(i);
+      v->adsrStart = v->adsr;
+      StepAdsr(v, &v->adsr, frames);
+      active |= GLM_ADSR_ACTIVE;
+      if(v->adsrStart.stage==ADSR_DONE) controls[i].flags |= GLM_VOICE_STOP, controlsDirty=1;
+    }
+    controls[i].rate       = active & (1<<GLM_PARAM_RATE) ? GLM_evalEnvelope(env+GLM_PARAM_RATE, 0) : 1;
+    controls[i].automation = active;
+  }
+  controlsSeen = 1; /* the mix callback runs next */
+}